@@ -9,6 +9,27 @@
 #define DEBUG 1
 
 #include "udriver_pca9685.h"
+#include "udriver_pca9685_scheduler.h"
+#include "udriver_pca9685_governor.h"
+#include "udriver_pca9685_phase.h"
+#include "udriver_pca9685_dither.h"
+#include "udriver_pca9685_gamma.h"
+#include "udriver_pca9685_animator.h"
+#include "udriver_pca9685_kernels.h"
+#include "udriver_pca9685_executor.h"
+#include "udriver_pca9685_mailbox.h"
+#include "udriver_pca9685_scrubber.h"
+#include "udriver_pca9685_calibration.h"
+#include "udriver_pca9685_power.h"
+#include "udriver_pca9685_radio.h"
+#include "udriver_pca9685_ingest.h"
+#include "udriver_pca9685_async.h"
+#include "udriver_pca9685_daemon.h"
+#include "udriver_pca9685_checkpoint.h"
+#include "udriver_pca9685_trace.h"
+#include "udriver_pca9685_channelmap.h"
+#include "udriver_pca9685_planner.h"
+#include "udriver_pca9685_motor.h"
 #include "utest/utest.h"
 #include "utest/utest.c"
 
@@ -43,6 +64,17 @@ namespace Test
         device.register_write(0x06, 0xFF);
         device.software_reset();
         TEST_EQUAL(device.register_read(0x6), 0x0);
+
+        //Other PCA9685s on the bus forget their registers and auto increment
+        PCA9685 other;
+        const uint16_t values[1] = { 1000 };
+        other.pwm_write_burst(Pin_P3, values, 1);
+        TEST_EQUAL(other.auto_inc, true);
+        device.reset_error_stats();
+        device.software_reset();
+        TEST_EQUAL(device.get_error_stats().transactions, 1);
+        TEST_EQUAL(other.auto_inc, false);
+        TEST_EQUAL(other.is_channel_off(Pin_P3), true);
     }
     
     void test_sleep()
@@ -228,6 +260,1383 @@ namespace Test
         device.move_servo(Pin_P15, 90);
     }
     
+    /* Stand-in for the /OE GPIO that records the last value driven */
+    class TestOutputEnablePin : public OutputEnablePin
+    {
+    public:
+        int digital = -1;
+        int analog = -1;
+        int edges = 0;
+
+        virtual void write_digital(int value) 
+        { 
+            this->digital = value; 
+            this->analog = -1; 
+            this->edges ++;
+        }
+        virtual void write_analog(int value) 
+        { 
+            this->analog = value; 
+            this->digital = -1; 
+        }
+    };
+
+    void test_output_enable()
+    {
+        PCA9685 device;
+        TestOutputEnablePin oe;
+        device.attach_output_enable(&oe);
+        TEST_EQUAL(oe.digital, 0);
+
+        device.pwm_write(Pin_P0, 2048);
+        device.blank();
+        TEST_EQUAL(oe.digital, 1);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P0)), 0x00);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P0)), 0x08);
+
+        device.unblank();
+        TEST_EQUAL(oe.digital, 0);
+        TEST_EQUAL(oe.edges, 3);
+
+        device.dim(256);
+        TEST_EQUAL(oe.analog, 1023 - 256);
+        device.blank();
+        TEST_EQUAL(oe.digital, 1);
+        device.unblank();
+        TEST_EQUAL(oe.analog, 1023 - 256);
+        device.dim(1023);
+        TEST_EQUAL(oe.digital, 0);
+
+        device.attach_output_enable(NULL);
+    }
+    
+    void test_pwm_write_burst()
+    {
+        PCA9685 device;
+        uint16_t values[4] = { 0, 1, 2048, 4095 };
+        device.pwm_write_burst(Pin_P4, values, 4);
+        
+        for(int i = 0; i < 4; i ++)
+        {
+            TEST_EQUAL(device.register_read(REG_ADDR_ON_L(Pin_P4 + i)), 0x00);
+            TEST_EQUAL(device.register_read(REG_ADDR_ON_H(Pin_P4 + i)), 0x00);
+            TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P4 + i)), (values[i] & 0xFF));
+            TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P4 + i)), (values[i] >> 8));
+        }
+    }
+
+    void test_bus_scheduler()
+    {
+        PCA9685 device;
+        BusScheduler scheduler(4);
+        uint16_t leds[16];
+        for(int i = 0; i < 16; i ++) leds[i] = i * 16;
+        uint16_t servo = 307;
+
+        //Bulk LED update gets preempted by the servo between chunks
+        TEST_EQUAL(scheduler.submit(device, Pin_P0, leds, 16, Priority_Bulk), MICROBIT_OK);
+        TEST_EQUAL(scheduler.run_once(), true);
+        TEST_EQUAL(scheduler.submit(device, Pin_P15, &servo, 1, Priority_Servo,
+                BusScheduler::period_deadline(50)), MICROBIT_OK);
+        TEST_EQUAL(scheduler.run_once(), true);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P15)), (307 & 0xFF));
+        TEST_EQUAL(scheduler.pending(), 1);
+        
+        TEST_EQUAL(scheduler.run(), 3);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P15)), (240 & 0xFF));
+        TEST_EQUAL(scheduler.pending(), 0);
+
+        const SchedulerStats &stats = scheduler.get_stats();
+        TEST_EQUAL(stats.completed, 2);
+        TEST_EQUAL(stats.transactions, 5);
+        TEST_EQUAL(stats.preemptions, 1);
+        DPRINTF("Scheduler deadline misses: %d\r\n", (int)stats.deadline_misses);
+
+        //A chunked preemption is counted once
+        scheduler.reset_stats();
+        scheduler.submit(device, Pin_P0, leds, 8, Priority_Bulk);
+        scheduler.run_once();
+        scheduler.submit(device, Pin_P8, leds, 8, Priority_Servo);
+        TEST_EQUAL(scheduler.run(), 3);
+        TEST_EQUAL(stats.preemptions, 1);
+
+        //Failed transactions are not reported as delivered
+        ErrorPolicy policy = { 0, 0, false, false };
+        device.set_error_policy(policy);
+        device.address = 0x10;
+        scheduler.reset_stats();
+        scheduler.submit(device, Pin_P0, leds, 4, Priority_Normal);
+        TEST_EQUAL(scheduler.run(), 0);
+        TEST_EQUAL(stats.errors, 1);
+        TEST_EQUAL(stats.completed, 0);
+        TEST_EQUAL(scheduler.pending(), 1);
+        device.address = I2C_ADDRESS_ALL_CALL;
+        TEST_EQUAL(scheduler.run(), 1);
+        TEST_EQUAL(stats.completed, 1);
+    }
+    
+    void test_update_governor()
+    {
+        PCA9685 device;
+        device.set_pwm_frequency(50);
+        UpdateGovernor governor(device);
+
+        //Several writes within a period are merged into the last one
+        for(int i = 0; i <= 100; i ++) governor.pwm_write(Pin_P13, 200 + i);
+        governor.pwm_write(Pin_P14, 400);
+        TEST_EQUAL(governor.flush(), 2);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P13)), (300 & 0xFF));
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P13)), (300 >> 8));
+
+        //Nothing more is written until the next period boundary
+        governor.pwm_write(Pin_P13, 310);
+        TEST_EQUAL(governor.flush(), 0);
+        uBit.sleep(20);
+        TEST_EQUAL(governor.flush(), 1);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P13)), (310 & 0xFF));
+
+        //Unchanged values are never sent
+        governor.pwm_write(Pin_P14, 400);
+        TEST_EQUAL(governor.flush_now(), 0);
+
+        //Compared against the registers, not the governor's last write
+        device.pwm_write(Pin_P14, 500);
+        governor.pwm_write(Pin_P14, 400);
+        TEST_EQUAL(governor.flush_now(), 1);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P14)), (400 & 0xFF));
+
+        const GovernorStats &stats = governor.get_stats();
+        TEST_EQUAL(stats.requested, 105);
+        TEST_EQUAL(stats.written, 4);
+        TEST_EQUAL(stats.suppressed, 101);
+
+        //A failed burst stays pending until it can be written
+        ErrorPolicy policy = { 0, 0, false, false };
+        device.set_error_policy(policy);
+        device.address = 0x10;
+        governor.pwm_write(Pin_P5, 700);
+        TEST_EQUAL((governor.flush_now() < 0), true);
+        TEST_EQUAL(stats.errors, 1);
+        device.address = I2C_ADDRESS_ALL_CALL;
+        TEST_EQUAL(governor.flush_now(), 1);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P5)), (700 & 0xFF));
+        device.set_pwm_frequency(200);
+    }
+    
+    void test_phase_allocator()
+    {
+        PCA9685 device;
+        PhaseAllocator phase(device, Phase_RoundRobin);
+        uint16_t values[16];
+        for(int i = 0; i < 16; i ++) values[i] = 1024;
+
+        phase.pwm_write_frame(values);
+        TEST_EQUAL(phase.get_offset(Pin_P1), 256);
+        TEST_EQUAL(device.register_read(REG_ADDR_ON_L(Pin_P1)), 0x00);
+        TEST_EQUAL(device.register_read(REG_ADDR_ON_H(Pin_P1)), 0x01);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P1)), 0x00);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P1)), 0x05);
+        
+        //OFF wraps around the end of the PWM period
+        device.pwm_pulse(Pin_P15, 1500);
+        TEST_EQUAL(phase.pwm_write(Pin_P15, 2048), MICROBIT_OK);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P15)), 0x07);
+        TEST_EQUAL(phase.pwm_write(Pin_P15, 5000), MICROBIT_INVALID_PARAMETER);
+
+        //No longer a pulse, so a frequency change keeps the offset
+        device.set_pwm_frequency(200);
+        TEST_EQUAL(device.register_read(REG_ADDR_ON_H(Pin_P15)), 0x0F);
+
+        int before, after;
+        phase.pwm_write_frame(values);
+        phase.report(&before, &after);
+        TEST_EQUAL(before, 16);
+        TEST_EQUAL(after, 2);
+        
+        PhaseAllocator balanced(device, Phase_LoadBalanced);
+        for(int i = 0; i < 16; i ++) values[i] = (i % 2) ? 3000 : 200;
+        balanced.pwm_write_frame(values);
+        balanced.report(&before, &after);
+        DPRINTF("Peak simultaneous edges: before %d after %d\r\n", before, after);
+        TEST_EQUAL((after < before), true);
+
+        //Out of range values are written as 0, so they are placed as 0
+        for(int i = 0; i < 16; i ++) values[i] = 0;
+        values[0] = 60000;
+        values[1] = values[2] = 1024;
+        balanced.assign(values);
+        TEST_EQUAL(balanced.get_offset(Pin_P1), 0);
+        TEST_EQUAL(balanced.get_offset(Pin_P2), 1024);
+    }
+    
+    void test_dither_engine()
+    {
+        PCA9685 device;
+        DitherEngine dither(device);
+
+        //Half a 12 bit step alternates between the two nearest values
+        dither.set_level(Pin_P0, 8);
+        for(int i = 0; i < 4; i ++)
+        {
+            dither.frame_now();
+            TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P0)), (i % 2));
+        }
+
+        //Over 16 periods the values average out to the 16 bit level
+        uint16_t levels[2] = { 4663, 65535 };
+        dither.set_levels(Pin_P1, levels, 2);
+        int sum = 0;
+        for(int i = 0; i < 16; i ++)
+        {
+            dither.frame_now();
+            sum += dither.written[Pin_P1];
+        }
+        TEST_EQUAL(sum, 4663);
+        TEST_EQUAL(dither.written[Pin_P2], 4095);
+        
+        //Settled PWM Pins are not resent
+        dither.release(Pin_P0);
+        dither.release(Pin_P1);
+        uint32_t bursts = dither.get_stats().bursts;
+        TEST_EQUAL(dither.frame_now(), 0);
+        TEST_EQUAL(dither.get_stats().bursts, bursts);
+
+        //A failed frame is not recorded as written
+        ErrorPolicy policy = { 0, 0, false, false };
+        device.set_error_policy(policy);
+        device.address = 0x10;
+        dither.set_level(Pin_P4, 65535);
+        TEST_EQUAL((dither.frame_now() < 0), true);
+        TEST_EQUAL(dither.get_stats().errors, 1);
+        TEST_EQUAL(dither.written[Pin_P4], 0);
+        device.address = I2C_ADDRESS_ALL_CALL;
+        TEST_EQUAL(dither.frame_now(), 1);
+        TEST_EQUAL(dither.written[Pin_P4], 4095);
+    }
+    
+    void test_brightness_map()
+    {
+        BrightnessMap brightness(Curve_Linear);
+        brightness.set_curve(Pin_P1, Curve_Gamma22);
+        brightness.set_curve_group((1 << Pin_P2) | (1 << Pin_P3), Curve_CIE1931);
+
+        TEST_EQUAL(brightness.map(Pin_P0, 0), 0);
+        TEST_EQUAL(brightness.map(Pin_P0, 1023), 4095);
+        TEST_EQUAL(brightness.map(Pin_P0, 512), 512 * 4095 / 1023);
+        TEST_EQUAL(brightness.map(Pin_P1, 1023), 4095);
+        TEST_EQUAL(brightness.map(Pin_P2, 1023), 4095);
+
+        //Perceptual curves stay well below linear at low brightness
+        TEST_EQUAL((brightness.map(Pin_P1, 256) < 512), true);
+        TEST_EQUAL((brightness.map(Pin_P2, 256) < 512), true);
+        for(int i = 1; i <= 1023; i ++)
+            TEST_EQUAL((brightness.map(Pin_P3, i) >= brightness.map(Pin_P3, i - 1)), true);
+
+        PCA9685 device;
+        uint16_t values[4] = { 0, 1023, 1023, 512 };
+        brightness.write(device, Pin_P0, values, 4);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P1)), 0x0F);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P3)), 
+            (brightness.map(Pin_P3, 512) & 0xFF));
+    }
+    
+    void test_animator()
+    {
+        PCA9685 device;
+        Animator animator;
+        const Keyframe fade[] = { { 0, 0, Ease_Linear }, { 1000, 4000, Ease_Linear } };
+        const Keyframe blink[] = 
+        { 
+            { 0, 4095, Ease_Step }, { 100, 0, Ease_Step }, { 200, 4095, Ease_Step } 
+        };
+        const Keyframe ease[] = { { 0, 0, Ease_InOut }, { 100, 1000, Ease_InOut } };
+
+        int fade_track = animator.add_track(device, Pin_P0, fade, 2);
+        int blink_track = animator.add_track(device, Pin_P1, blink, 3, true);
+        int ease_track = animator.add_track(device, Pin_P2, ease, 2, false, 7);
+        animator.play(fade_track);
+        animator.play(blink_track);
+
+        TEST_EQUAL(animator.tick(5000), 2);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P1)), 0x0F);
+        TEST_EQUAL(animator.tick(5500), 2);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P0)), (2000 & 0xFF));
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P0)), (2000 >> 8));
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P1)), 0x00);
+        TEST_EQUAL(animator.tick(5650), 2);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P1)), 0x0F);
+
+        //Finished tracks stop and are no longer evaluated
+        animator.tick(6000);
+        TEST_EQUAL(animator.is_playing(fade_track), false);
+        TEST_EQUAL(animator.is_playing(blink_track), true);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P0)), (4000 & 0xFF));
+
+        //Triggered track eases in and out
+        animator.trigger(7);
+        TEST_EQUAL(animator.is_playing(ease_track), true);
+        animator.tick(6050);
+        TEST_EQUAL(animator.tracks[ease_track].value, 500);
+        animator.tick(6110);
+        TEST_EQUAL(animator.tracks[ease_track].value, 1000);
+        TEST_EQUAL(animator.is_playing(ease_track), false);
+        animator.remove_track(blink_track);
+        TEST_EQUAL(animator.tick(6200), 0);
+
+        //A failed burst is retried on the next tick
+        ErrorPolicy policy = { 0, 0, false, false };
+        device.set_error_policy(policy);
+        device.address = 0x10;
+        animator.play(fade_track);
+        TEST_EQUAL((animator.tick(6300) < 0), true);
+        TEST_EQUAL(animator.tracks[fade_track].fresh, true);
+        TEST_EQUAL(animator.tracks[fade_track].value, 4000);
+        device.address = I2C_ADDRESS_ALL_CALL;
+        TEST_EQUAL(animator.tick(6400), 1);
+        TEST_EQUAL(animator.tracks[fade_track].value, 400);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P0)), (400 >> 8));
+        animator.remove_track(fade_track);
+        animator.remove_track(ease_track);
+
+        //Devices left out for lack of room go first on the next tick
+        const int extra = UDRIVER_PCA9685_ANIMATOR_DEVICES + 1;
+        PCA9685 devices[extra];
+        const Keyframe hold[] = { { 0, 300, Ease_Step } };
+        int held[extra];
+        for(int i = 0; i < extra; i ++)
+        {
+            held[i] = animator.add_track(devices[i], Pin_P3, hold, 1);
+            animator.play(held[i]);
+        }
+        TEST_EQUAL(animator.tick(6500), UDRIVER_PCA9685_ANIMATOR_DEVICES);
+        TEST_EQUAL(animator.playing_count, 1);
+        TEST_EQUAL(animator.tick(6600), 1);
+        for(int i = 0; i < extra; i ++)
+            TEST_EQUAL(animator.is_playing(held[i]), false);
+    }
+    
+    void test_kernels()
+    {
+        const int devices = 4;
+        const int count = devices * 16;
+        static uint16_t angles[count], min_us[count], max_us[count];
+        static uint16_t pulses[count], values[count];
+        static uint8_t regs[devices * UDRIVER_PCA9685_BURST_BYTES];
+
+        for(int i = 0; i < count; i ++)
+        {
+            angles[i] = i * UDRIVER_PCA9685_ANGLE_MAX / (count - 1);
+            min_us[i] = 1000;
+            max_us[i] = 2000;
+        }
+        Kernels::angles_to_pulses(angles, min_us, max_us, pulses, count);
+        TEST_EQUAL(pulses[0], 1000);
+        TEST_EQUAL(pulses[count - 1], 2000);
+
+        //Matches the per channel conversion in pwm_pulse() exactly
+        PCA9685 device;
+        device.set_pwm_frequency(50);
+        Kernels::pulses_to_values(pulses, values, count, 50);
+        for(int i = 0; i < count; i ++)
+        {
+            device.pwm_pulse(Pin_P0, pulses[i]);
+            TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P0)), (values[i] & 0xFF));
+            TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P0)), (values[i] >> 8));
+        }
+        //Halves round up: 2000us at 50Hz is 409.5 PWM divisions
+        TEST_EQUAL(values[count - 1], 410);
+
+        //Pulses outside the PWM period are rejected and not recorded
+        TEST_EQUAL(device.pwm_pulse(Pin_P1, 20001), MICROBIT_INVALID_PARAMETER);
+        TEST_EQUAL(device.pwm_pulse(Pin_P1, -1), MICROBIT_INVALID_PARAMETER);
+        TEST_EQUAL((device.pulse_mode & (1 << Pin_P1)), 0);
+
+        Kernels::encode_bursts(values, regs, devices);
+        TEST_EQUAL(regs[(count - 1) * 4 + 2], (values[count - 1] & 0xFF));
+        TEST_EQUAL(regs[(count - 1) * 4 + 3], (values[count - 1] >> 8));
+
+        //Benchmark: per channel double math like move_servo() vs the kernels
+        const int rounds = 20;
+        double tick = (1.0/50.0) * 1000.0 * 1000.0 / 4095.0;
+        uint64_t start_us = system_timer_current_time_us();
+        for(int r = 0; r < rounds; r ++)
+        {
+            for(int i = 0; i < count; i ++)
+            {
+                double angle_deg = angles[i] / 10.0;
+                int pulse_us = round((angle_deg / 180.0) * (2000.0 - 1000.0) + 1000.0);
+                int value = round((double) pulse_us / tick);
+                PCA9685::encode_channel(0, value, regs + i * 4);
+            }
+        }
+        uint32_t scalar_us = system_timer_current_time_us() - start_us;
+        
+        start_us = system_timer_current_time_us();
+        for(int r = 0; r < rounds; r ++)
+        {
+            Kernels::angles_to_pulses(angles, min_us, max_us, pulses, count);
+            Kernels::pulses_to_values(pulses, values, count, 50);
+            Kernels::encode_bursts(values, regs, devices);
+        }
+        uint32_t kernel_us = system_timer_current_time_us() - start_us;
+
+        DPRINTF("Convert %d channels: scalar %d us, kernels %d us\r\n", 
+            count * rounds, (int)scalar_us, (int)kernel_us);
+    }
+    
+    void test_bus_executor()
+    {
+        PCA9685 device(I2C_ADDRESS_ALL_CALL, I2CBus::primary());
+        BusExecutor executor;
+        uint16_t values[16];
+        for(int i = 0; i < 16; i ++) values[i] = i * 256;
+
+        TEST_EQUAL(executor.stage(device, Pin_P0, values, 16), MICROBIT_OK);
+        TEST_EQUAL(executor.commit(), 16);
+        TEST_EQUAL(executor.bus_count(), 1);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P15)), 0x0F);
+
+        //Benchmark: PWM Pin updates per second through the executor, on the
+        //one bus of the test rig
+        const int frames = 50;
+        executor.reset_stats();
+        uint64_t start_us = system_timer_current_time_us();
+        for(int frame = 0; frame < frames; frame ++)
+        {
+            values[0] = frame;
+            executor.stage(device, Pin_P0, values, 16);
+            executor.commit();
+        }
+        uint32_t elapsed_us = system_timer_current_time_us() - start_us;
+        
+        const ExecutorStats &stats = executor.get_stats();
+        TEST_EQUAL(stats.frames, frames);
+        TEST_EQUAL(stats.updates, frames * 16);
+        DPRINTF("Executor on 1 bus: %d updates/s, max frame %d us\r\n",
+            (int)((uint64_t)stats.updates * 1000000 / elapsed_us), (int)stats.max_frame_us);
+
+        //Workers are joined on shutdown, and started again when needed
+        executor.shutdown();
+        TEST_EQUAL(executor.bus_count(), 0);
+        TEST_EQUAL(executor.stage(device, Pin_P0, values, 1), MICROBIT_OK);
+        TEST_EQUAL(executor.commit(), 1);
+
+        //Failed bursts are reported and not counted as updates
+        ErrorPolicy policy = { 0, 0, false, false };
+        device.set_error_policy(policy);
+        device.address = 0x10;
+        executor.reset_stats();
+        executor.stage(device, Pin_P0, values, 4);
+        TEST_EQUAL((executor.commit() < 0), true);
+        TEST_EQUAL(stats.errors, 1);
+        TEST_EQUAL(stats.updates, 0);
+        device.address = I2C_ADDRESS_ALL_CALL;
+        executor.shutdown();
+    }
+    
+    static PCA9685 *lock_device;
+    static volatile bool lock_holder_done;
+
+    static void lock_holder(void *)
+    {
+        BusTransaction transaction(lock_device->get_bus());
+        fiber_sleep(50); //Yield while holding the bus
+        lock_device->pwm_write(Pin_P0, 1000);
+        lock_holder_done = true;
+    }
+
+    void test_bus_locking()
+    {
+        PCA9685 device;
+        lock_device = &device;
+        lock_holder_done = false;
+
+        //Stress: the write waits for the other fiber's transaction
+        create_fiber(lock_holder, NULL);
+        fiber_sleep(10);
+        device.pwm_write(Pin_P0, 2000);
+        TEST_EQUAL(lock_holder_done, true);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P0)), (2000 & 0xFF));
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P0)), (2000 >> 8));
+
+        //Benchmark: uncontended and nested lock cost
+        const int rounds = 10000;
+        I2CBus &bus = device.get_bus();
+        uint64_t start_us = system_timer_current_time_us();
+        for(int i = 0; i < rounds; i ++)
+        {
+            bus.lock();
+            bus.lock();
+            bus.unlock();
+            bus.unlock();
+        }
+        uint32_t elapsed_us = system_timer_current_time_us() - start_us;
+        DPRINTF("Bus lock: %d ns per uncontended lock/unlock\r\n", 
+            (int)((uint64_t)elapsed_us * 1000 / (rounds * 2)));
+
+        //Benchmark: hand over of a contended bus between fibers
+        lock_holder_done = false;
+        create_fiber(lock_holder, NULL);
+        fiber_sleep(10);
+        start_us = system_timer_current_time_us();
+        bus.lock();
+        elapsed_us = system_timer_current_time_us() - start_us;
+        bus.unlock();
+        DPRINTF("Bus lock: waited %d us for a contended bus\r\n", (int)elapsed_us);
+    }
+    
+    static Mailbox *test_mailbox_box;
+
+    static void mailbox_producer(void *)
+    {
+        for(int i = 0; i < 20; i ++)
+        {
+            test_mailbox_box->set(Pin_P3, i * 100);
+            test_mailbox_box->publish();
+            fiber_sleep(5);
+        }
+    }
+
+    void test_mailbox()
+    {
+        PCA9685 device;
+        Mailbox mailbox(device);
+        test_mailbox_box = &mailbox;
+        TEST_EQUAL(mailbox.service(), 0);
+
+        //Frames published before the consumer runs are merged into the last
+        mailbox.set(Pin_P0, 100);
+        mailbox.publish();
+        mailbox.set(Pin_P1, 200);
+        mailbox.publish();
+        TEST_EQUAL(mailbox.service(), 16);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P0)), 100);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P1)), 200);
+        TEST_EQUAL(mailbox.service(), 0);
+        
+        //Only the changed span is sent
+        mailbox.set(Pin_P1, 201);
+        mailbox.set(Pin_P2, 202);
+        mailbox.publish();
+        TEST_EQUAL(mailbox.service(), 2);
+
+        //A failed frame is resent with the next one
+        ErrorPolicy policy = { 0, 0, false, false };
+        device.set_error_policy(policy);
+        device.address = 0x10;
+        mailbox.set(Pin_P4, 204);
+        mailbox.publish();
+        TEST_EQUAL((mailbox.service() < 0), true);
+        TEST_EQUAL(mailbox.get_stats().errors, 1);
+        device.address = I2C_ADDRESS_ALL_CALL;
+        mailbox.set(Pin_P5, 205);
+        mailbox.publish();
+        TEST_EQUAL(mailbox.service(), 2);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P4)), 204);
+
+        //Latency from producer publish to bus transmission
+        mailbox.reset_stats();
+        create_fiber(mailbox_producer, NULL);
+        uint64_t end_us = system_timer_current_time_us() + 150000;
+        while(system_timer_current_time_us() < end_us)
+        {
+            mailbox.service();
+            fiber_sleep(1);
+        }
+        const MailboxStats &stats = mailbox.get_stats();
+        TEST_EQUAL(stats.published, 20);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P3)), (1900 & 0xFF));
+        DPRINTF("Mailbox latency: min %d us, avg %d us, max %d us over %d frames\r\n",
+            (int)stats.latency_min_us, (int)(stats.latency_total_us / stats.consumed),
+            (int)stats.latency_max_us, (int)stats.consumed);
+    }
+    
+    static int error_handler_calls;
+    static int error_handler_status;
+
+    static void test_error_handler(PCA9685 &device, int status)
+    {
+        error_handler_calls ++;
+        error_handler_status = status;
+    }
+
+    void test_error_policy()
+    {
+        PCA9685 device;
+        device.pwm_write(Pin_P2, 1234);
+        TEST_EQUAL(device.cache.channels[Pin_P2 * 4 + 2], (1234 & 0xFF));
+        TEST_EQUAL(device.cache.channels[Pin_P2 * 4 + 3], (1234 >> 8));
+
+        //Registers lost on the PCA9685 are restored from the cache
+        device.register_write(REG_ADDR_OFF_L(Pin_P2), 0x00);
+        device.cache.channels[Pin_P2 * 4 + 2] = (1234 & 0xFF);
+        TEST_EQUAL(device.restore_state(), MICROBIT_OK);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P2)), (1234 & 0xFF));
+
+        //Without a PCA9685 at the address, writes fail without panicking
+        ErrorPolicy policy = { 1, 100, false, false };
+        device.set_error_policy(policy);
+        device.set_error_handler(test_error_handler);
+        device.reset_error_stats();
+        error_handler_calls = 0;
+        device.address = 0x10;
+        TEST_EQUAL((device.pwm_write(Pin_P2, 100) != MICROBIT_OK), true);
+        TEST_EQUAL(device.pwm_write(Pin_P2, 9999), MICROBIT_INVALID_PARAMETER);
+        
+        const ErrorStats &stats = device.get_error_stats();
+        TEST_EQUAL(stats.errors, 1);
+        TEST_EQUAL(stats.failures, 2);
+        TEST_EQUAL(error_handler_calls, 1);
+        TEST_EQUAL((error_handler_status != MICROBIT_OK), true);
+    }
+    
+    void test_scrubber()
+    {
+        PCA9685 device;
+        Scrubber scrubber(device, 100);
+        device.pwm_write(Pin_P0, 1234);
+
+        //A register changed behind the driver's back is rewritten
+        device.register_write(REG_ADDR_OFF_L(Pin_P0), 0x00);
+        device.cache.channels[Pin_P0 * 4 + 2] = (1234 & 0xFF);
+        TEST_EQUAL(scrubber.step(), 1);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P0)), (1234 & 0xFF));
+        for(int i = 0; i < 15; i ++) TEST_EQUAL(scrubber.step(), 0);
+
+        //A reset is detected from MODE1 and everything is restored
+        PCA9685::RegisterCache cache = device.cache;
+        device.software_reset();
+        device.cache = cache;
+        device.auto_inc = true;
+        TEST_EQUAL(scrubber.step(), 0);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P0)), (1234 & 0xFF));
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P0)), (1234 >> 8));
+
+        const ScrubberStats &stats = scrubber.get_stats();
+        TEST_EQUAL(stats.resets, 1);
+        TEST_EQUAL(stats.repaired, 1);
+        DPRINTF("Scrubber: reset detected within %d us\r\n", (int)stats.detect_us);
+
+        //Slots are skipped to stay within a small budget
+        scrubber.set_budget(1);
+        scrubber.reset_stats();
+        uint64_t end_us = system_timer_current_time_us() + 200000;
+        while(system_timer_current_time_us() < end_us) scrubber.step();
+        DPRINTF("Scrubber: %d steps, %d skipped, %d us on bus\r\n",
+            (int)stats.steps, (int)stats.skipped, (int)stats.bus_us);
+        TEST_EQUAL((stats.bus_us * 100 <= 200000 * 2), true);
+    }
+    
+    void test_servo_calibration()
+    {
+        //Nonlinear servo measured every 45 degrees
+        const uint16_t measured[5] = { 600, 1000, 1450, 1900, 2350 };
+        ServoCalibration calibration(measured, 5);
+        TEST_EQUAL(calibration.pulse(0), 600);
+        TEST_EQUAL(calibration.pulse(225), 800);
+        TEST_EQUAL(calibration.pulse(450), 1000);
+        TEST_EQUAL(calibration.pulse(900), 1450);
+        TEST_EQUAL(calibration.pulse(1800), 2350);
+        TEST_EQUAL(calibration.pulse(2000), 2350);
+
+        //Pins share the table and move_servo() goes through it
+        PCA9685ServoController device;
+        device.calibrate_servo(Pin_P13, &calibration);
+        device.calibrate_servo(Pin_P15, &calibration);
+        TEST_EQUAL(device.pulse_min[Pin_P13], 600);
+        TEST_EQUAL(device.pulse_max[Pin_P15], 2350);
+        device.move_servo(Pin_P13, 0);
+        TEST_EQUAL(device.pulse_len[Pin_P13], 600);
+        device.move_servo(Pin_P15, 90);
+        TEST_EQUAL(device.pulse_len[Pin_P15], 1450);
+
+        //Uncalibrated servos map over the configured pulses
+        device.configure_servo(Pin_P14, 544, 2400);
+        device.move_servo(Pin_P14, 180);
+        TEST_EQUAL(device.pulse_len[Pin_P14], 2400);
+        device.move_servo(Pin_P14, 90);
+        TEST_EQUAL(device.pulse_len[Pin_P14], 1472);
+
+        //Batch move in one burst
+        const uint16_t angles[3] = { 450, 900, 1800 };
+        TEST_EQUAL(device.move_servos(Pin_P13, angles, 3), MICROBIT_OK);
+        TEST_EQUAL(device.pulse_len[Pin_P13], 1000);
+        TEST_EQUAL(device.pulse_len[Pin_P14], 1472);
+        TEST_EQUAL(device.pulse_len[Pin_P15], 2350);
+        
+        //Benchmark: double math per servo vs the calibration table
+        const int iterations = 1000;
+        volatile int sink = 0;
+        uint64_t start_us = system_timer_current_time_us();
+        for(int i = 0; i < iterations; i ++)
+        {
+            double angle_deg = (i % 1800) / 10.0;
+            sink += round((angle_deg / 180.0) * (2000.0 - 1000.0) + 1000.0);
+        }
+        uint64_t double_us = system_timer_current_time_us() - start_us;
+        start_us = system_timer_current_time_us();
+        for(int i = 0; i < iterations; i ++) sink += calibration.pulse(i % 1800);
+        uint64_t table_us = system_timer_current_time_us() - start_us;
+        DPRINTF("Calibration: %d conversions, double %d us, table %d us\r\n",
+            iterations, (int)double_us, (int)table_us);
+    }
+    
+    void test_power_manager()
+    {
+        PCA9685 device;
+        device.digital_write_all(0);
+        PowerManager power(device, 50);
+        power.set_hold(Pin_P1, 0);
+
+        //Servos are released after their hold, LEDs and unheld pins are not
+        power.pwm_pulse(Pin_P0, 1500);
+        power.pwm_write(Pin_P2, 2048);
+        uBit.sleep(60);
+        TEST_EQUAL(power.step(), MICROBIT_OK);
+        TEST_EQUAL((device.register_read(REG_ADDR_OFF_H(Pin_P0)) & 0x10), 0x10);
+        TEST_EQUAL(device.is_channel_off(Pin_P2), false);
+        TEST_EQUAL(power.is_asleep(), false);
+
+        //Asleep once everything is off
+        power.pwm_write(Pin_P2, 0);
+        TEST_EQUAL(power.step(), MICROBIT_OK);
+        TEST_EQUAL(power.is_asleep(), true);
+        TEST_EQUAL((device.register_read(0x00) & 0x10), 0x10);
+
+        //The next command wakes it and resumes the servo
+        uBit.sleep(100);
+        power.pwm_pulse(Pin_P0, 1500);
+        TEST_EQUAL(power.is_asleep(), false);
+        TEST_EQUAL((device.register_read(0x00) & 0x10), 0x00);
+        TEST_EQUAL((device.register_read(REG_ADDR_OFF_H(Pin_P0)) & 0x10), 0x00);
+
+        const PowerStats &stats = power.get_stats();
+        TEST_EQUAL(stats.releases, 1);
+        TEST_EQUAL(stats.sleeps, 1);
+        TEST_EQUAL((stats.asleep_ms >= 100), true);
+        DPRINTF("Power: asleep %d ms, wake latency %d us\r\n",
+            (int)stats.asleep_ms, (int)stats.wake_max_us);
+    }
+    
+    /* Stand-in for the radio that loops sent packets back, in order */
+    class TestRadioLink : public RadioLink
+    {
+    public:
+        uint8_t packets[8][UDRIVER_PCA9685_RADIO_PACKET_MAX];
+        int lengths[8];
+        int head = 0;
+        int tail = 0;
+
+        virtual int send(const uint8_t *data, int len)
+        {
+            if(this->tail - this->head == 8) return MICROBIT_NO_RESOURCES;
+            memcpy(this->packets[this->tail % 8], data, len);
+            this->lengths[this->tail % 8] = len;
+            this->tail ++;
+            return MICROBIT_OK;
+        }
+        virtual int receive(uint8_t *data, int len)
+        {
+            if(this->head == this->tail) return 0;
+            int packet_len = this->lengths[this->head % 8];
+            memcpy(data, this->packets[this->head % 8], packet_len);
+            this->head ++;
+            return packet_len;
+        }
+    };
+
+    void test_radio_receiver()
+    {
+        PCA9685 device;
+        TestRadioLink link;
+        RadioSender sender(link, 7);
+        RadioReceiver receiver(device, link, 7);
+        uint16_t values[UDRIVER_PCA9685_PIN_COUNT] = { 0 };
+        uint8_t frame[UDRIVER_PCA9685_RADIO_FRAME_MAX];
+
+        //Frames are merged with the newest value winning
+        values[Pin_P0] = 100;
+        values[Pin_P1] = 200;
+        sender.send((1 << Pin_P0) | (1 << Pin_P1), values);
+        values[Pin_P1] = 300;
+        values[Pin_P2] = 4095;
+        sender.send((1 << Pin_P1) | (1 << Pin_P2), values);
+        //Stale and foreign frames are dropped
+        link.send(frame, RadioFrame::encode(7, 0, (1 << Pin_P0), values, frame));
+        link.send(frame, RadioFrame::encode(8, 9, (1 << Pin_P0), values, frame));
+        
+        TEST_EQUAL(receiver.poll(), 2);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P0)), 100);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P1)), (300 & 0xFF));
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P1)), (300 >> 8));
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P2)), (4095 >> 8));
+
+        const RadioStats &stats = receiver.get_stats();
+        TEST_EQUAL(stats.received, 4);
+        TEST_EQUAL(stats.stale, 1);
+        TEST_EQUAL(stats.ignored, 1);
+        TEST_EQUAL(stats.bursts, 1);
+
+        //Benchmark: frames of all 16 PWM Pins vs a pwm_write() per Pin
+        const int frames = 50;
+        for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++) values[pin] = pin * 200;
+        uint64_t start_us = system_timer_current_time_us();
+        for(int i = 0; i < frames; i ++)
+        {
+            sender.send(0xFFFF, values);
+            receiver.poll();
+        }
+        uint64_t frame_us = system_timer_current_time_us() - start_us;
+        start_us = system_timer_current_time_us();
+        for(int i = 0; i < frames; i ++)
+        {
+            for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+                device.pwm_write((Pin)pin, values[pin]);
+        }
+        uint64_t write_us = system_timer_current_time_us() - start_us;
+        DPRINTF("Radio: %d frames, packed %d us, per pin %d us\r\n",
+            frames, (int)frame_us, (int)write_us);
+
+        //Every failed run is recorded, not only the first
+        ErrorPolicy policy = { 0, 0, false, false };
+        device.set_error_policy(policy);
+        device.address = 0x10;
+        receiver.reset_stats();
+        sender.send((1 << Pin_P0) | (1 << Pin_P2), values);
+        TEST_EQUAL((receiver.poll() < 0), true);
+        TEST_EQUAL(stats.errors, 2);
+        TEST_EQUAL(stats.applied, 0);
+        device.address = I2C_ADDRESS_ALL_CALL;
+    }
+    
+    void test_serial_ingest()
+    {
+        PCA9685 device;
+        PCA9685 *devices[1] = { &device };
+        SerialIngest ingest(devices, 1);
+        uint16_t values[UDRIVER_PCA9685_PIN_COUNT];
+        uint8_t frame[UDRIVER_PCA9685_INGEST_FRAME_MAX];
+
+        //Check value of CRC-16/CCITT-FALSE
+        TEST_EQUAL(SerialIngest::crc16((const uint8_t *)"123456789", 9), 0x29B1);
+
+        //A corrupt frame and line noise are skipped over
+        const uint8_t noise[3] = { UDRIVER_PCA9685_INGEST_SYNC0, 0x11, 0x00 };
+        for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++) values[pin] = pin * 100;
+        int len = SerialIngest::encode(0, Pin_P0, values, 4, frame);
+        frame[6] ^= 0x01;
+        TEST_EQUAL(ingest.feed(frame, len), 0);
+        TEST_EQUAL(ingest.feed(noise, 3), 0);
+        len = SerialIngest::encode(0, Pin_P4, values + 4, 4, frame);
+        //Split across reads like a serial port would
+        TEST_EQUAL(ingest.feed(frame, 3), 0);
+        TEST_EQUAL(ingest.feed(frame + 3, len - 3), 1);
+        TEST_EQUAL(ingest.service(), 1);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P5)), (500 & 0xFF));
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P7)), (700 >> 8));
+
+        const IngestStats &stats = ingest.get_stats();
+        TEST_EQUAL(stats.frames, 1);
+        TEST_EQUAL(stats.crc_errors, 1);
+
+        //The oldest frames are dropped when the bus falls behind
+        len = SerialIngest::encode(0, Pin_P0, values, 16, frame);
+        for(int i = 0; i < UDRIVER_PCA9685_INGEST_QUEUE + 2; i ++) ingest.feed(frame, len);
+        TEST_EQUAL(ingest.service(), UDRIVER_PCA9685_INGEST_QUEUE);
+        TEST_EQUAL(stats.dropped, 2);
+
+        //A frame failing to write is dropped, the next stays queued
+        ErrorPolicy policy = { 0, 0, false, false };
+        device.set_error_policy(policy);
+        device.address = 0x10;
+        ingest.feed(frame, len);
+        ingest.feed(frame, len);
+        TEST_EQUAL((ingest.service() < 0), true);
+        TEST_EQUAL(stats.dropped, 3);
+        device.address = I2C_ADDRESS_ALL_CALL;
+        TEST_EQUAL(ingest.service(), 1);
+
+        //Benchmark: frames of 16 PWM Pins from a stream vs text and pwm_write()
+        const int frames = 50;
+        ingest.reset_stats();
+        uint64_t start_us = system_timer_current_time_us();
+        for(int i = 0; i < frames; i ++)
+        {
+            ingest.feed(frame, len);
+            ingest.service();
+        }
+        uint64_t ingest_us = system_timer_current_time_us() - start_us;
+        start_us = system_timer_current_time_us();
+        for(int i = 0; i < frames; i ++)
+        {
+            for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+                device.pwm_write((Pin)pin, atoi("2048"));
+        }
+        uint64_t write_us = system_timer_current_time_us() - start_us;
+        DPRINTF("Ingest: %d frames in %d us (%d us on bus), per pin %d us\r\n",
+            (int)stats.written, (int)ingest_us, (int)stats.bus_us, (int)write_us);
+    }
+    
+    void count_async_op(AsyncOp &op)
+    {
+        (*(int *)op.context) ++;
+    }
+
+    void test_async()
+    {
+        const uint32_t latency_us = 2000;
+        PCA9685ServoController device;
+        AsyncLoop loop;
+        SimulatedTransport buses[3] = { latency_us, latency_us, latency_us };
+        AsyncOp ops[3];
+        int completed = 0;
+        for(int i = 0; i < 3; i ++)
+        {
+            ops[i].callback = count_async_op;
+            ops[i].context = &completed;
+        }
+
+        //Operations on different transports overlap
+        uint64_t start_us = system_timer_current_time_us();
+        for(int i = 0; i < 3; i ++)
+        {
+            AsyncDevice async_device(device, buses[i], loop);
+            async_device.pwm_write(Pin_P1, 1000 + i, ops[i]);
+        }
+        TEST_EQUAL(ops[0].done, false);
+        loop.wait_all();
+        uint64_t overlapped_us = system_timer_current_time_us() - start_us;
+        TEST_EQUAL(completed, 3);
+        TEST_EQUAL(ops[2].status, MICROBIT_OK);
+        TEST_EQUAL(buses[2].channels[Pin_P1 * 4 + 2], ((1000 + 2) & 0xFF));
+        TEST_EQUAL((overlapped_us < 2 * latency_us), true);
+
+        //Operations on one transport run in order
+        AsyncServoController async_servo(device, buses[0], loop);
+        start_us = system_timer_current_time_us();
+        async_servo.move_servo(Pin_P0, 0, ops[0]);
+        async_servo.move_servo(Pin_P0, 900, ops[1]);
+        TEST_EQUAL(loop.wait(ops[1]), MICROBIT_OK);
+        uint64_t serial_us = system_timer_current_time_us() - start_us;
+        TEST_EQUAL(ops[0].done, true);
+        TEST_EQUAL((serial_us >= 2 * latency_us), true);
+        //1500us at 50Hz
+        TEST_EQUAL(buses[0].channels[Pin_P0 * 4 + 2] | (buses[0].channels[Pin_P0 * 4 + 3] << 8), 307);
+        //Kept in range and recorded for set_pwm_frequency() like move_servo()
+        TEST_EQUAL(device.pulse_len[Pin_P0], 1500);
+        TEST_EQUAL((device.servo_mode & (1 << Pin_P0)) != 0, true);
+        async_servo.pwm_pulse(Pin_P0, 3000, ops[0]);
+        TEST_EQUAL(loop.wait(ops[0]), MICROBIT_OK);
+        TEST_EQUAL(device.pulse_len[Pin_P0], 2000);
+
+        //Through the device itself
+        DeviceTransport direct;
+        AsyncDevice async_device(device, direct, loop);
+        ops[0].callback = NULL;
+        async_device.pwm_write(Pin_P3, 1234, ops[0]);
+        TEST_EQUAL(loop.wait(ops[0]), MICROBIT_OK);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P3)), (1234 & 0xFF));
+        async_device.pwm_write(Pin_P3, 5000, ops[0]);
+        TEST_EQUAL(ops[0].status, MICROBIT_INVALID_PARAMETER);
+        PCA9685 plain;
+        AsyncDevice async_plain(plain, direct, loop);
+        async_plain.pwm_pulse(Pin_P3, -100, ops[0]);
+        TEST_EQUAL(ops[0].status, MICROBIT_INVALID_PARAMETER);
+        
+        DPRINTF("Async: 3 transfers of %d us, overlapped %d us, one bus %d us for 2\r\n",
+            (int)latency_us, (int)overlapped_us, (int)serial_us);
+    }
+    
+    void test_frame_daemon()
+    {
+        PCA9685 device;
+        FrameRegion region;
+        FrameDaemon daemon;
+        TEST_EQUAL(daemon.attach(device, region), MICROBIT_OK);
+        TEST_EQUAL(daemon.service(), 0);
+
+        //Writers only touch the region, the daemon writes the changed runs
+        const uint16_t lights[2] = { 1000, 2000 };
+        region.write_burst(Pin_P0, lights, 2);
+        region.write(Pin_P5, 3000);
+        region.write(Pin_P0, 1500);
+        TEST_EQUAL(daemon.service(), 3);
+        TEST_EQUAL(daemon.get_stats().bursts, 2);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P0)), (1500 & 0xFF));
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P1)), (2000 >> 8));
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P5)), (3000 >> 8));
+        TEST_EQUAL(daemon.service(), 0);
+
+        //A failed burst is written on a later pass, other devices meanwhile
+        PCA9685 missing;
+        FrameRegion missing_region;
+        ErrorPolicy policy = { 0, 0, false, false };
+        missing.set_error_policy(policy);
+        missing.address = 0x10;
+        daemon.attach(missing, missing_region);
+        missing_region.write(Pin_P0, 100);
+        region.write(Pin_P6, 600);
+        TEST_EQUAL((daemon.service() != MICROBIT_OK), true);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P6)), (600 & 0xFF));
+        missing.address = I2C_ADDRESS_ALL_CALL;
+        TEST_EQUAL(daemon.service(), 1);
+        TEST_EQUAL(daemon.get_stats().errors, 1);
+
+        //Benchmark: client write to bus latency through the daemon fiber
+        daemon.reset_stats();
+        daemon.start();
+        for(int i = 0; i < 20; i ++)
+        {
+            region.write(Pin_P3, i * 100);
+            uBit.sleep(10);
+        }
+        daemon.stop();
+        //Restarting straight away waits for the stopped fiber to exit
+        daemon.start();
+        daemon.stop();
+        uBit.sleep(20);
+        TEST_EQUAL(daemon.fiber_active, false);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P3)), ((19 * 100) >> 8));
+
+        //Destroying a running daemon waits for its fiber to exit
+        {
+            FrameDaemon scoped;
+            scoped.attach(device, region);
+            scoped.start();
+            region.write(Pin_P7, 700);
+            uBit.sleep(10);
+        }
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P7)), (700 & 0xFF));
+        
+        const DaemonStats &stats = daemon.get_stats();
+        DPRINTF("Daemon: %d bursts, latency avg %d us, max %d us, %d retries\r\n",
+            (int)stats.bursts, (int)(stats.latency_total_us / (stats.bursts ? stats.bursts : 1)),
+            (int)stats.latency_max_us, (int)region.retries);
+    }
+    
+    void test_checkpoint()
+    {
+        PCA9685ServoController device;
+        device.set_pwm_frequency(60);
+        device.configure_servo(Pin_P13, 544, 2400);
+        device.move_servo(Pin_P13, 90);
+        device.pwm_write(Pin_P2, 3000);
+        
+        uint64_t start_us = system_timer_current_time_us();
+        TEST_EQUAL(Checkpoint::save(device, "utest"), MICROBIT_OK);
+        uint64_t save_us = system_timer_current_time_us() - start_us;
+        //Saving the same state again leaves the flash alone
+        start_us = system_timer_current_time_us();
+        TEST_EQUAL(Checkpoint::save(device, "utest"), MICROBIT_OK);
+        uint64_t resave_us = system_timer_current_time_us() - start_us;
+
+        //Brought back after a reset
+        device.software_reset();
+        PCA9685ServoController restored;
+        start_us = system_timer_current_time_us();
+        TEST_EQUAL(Checkpoint::restore(restored, "utest"), MICROBIT_OK);
+        uint64_t restore_us = system_timer_current_time_us() - start_us;
+        TEST_EQUAL(restored.get_pwm_frequency(), 60);
+        TEST_EQUAL(restored.pulse_min[Pin_P13], 544);
+        TEST_EQUAL(restored.pulse_max[Pin_P13], 2400);
+        TEST_EQUAL(restored.pulse_len[Pin_P13], 1472);
+        TEST_EQUAL(((restored.servo_mode >> Pin_P13) & 1), 1);
+        TEST_EQUAL(restored.register_read(0xFE), device.cache.prescale);
+        TEST_EQUAL(restored.register_read(REG_ADDR_OFF_L(Pin_P2)), (3000 & 0xFF));
+        TEST_EQUAL(restored.register_read(REG_ADDR_OFF_H(Pin_P2)), (3000 >> 8));
+        
+        //A plain PCA9685 does not take a servo controller's checkpoint
+        PCA9685 plain;
+        TEST_EQUAL(Checkpoint::restore(plain, "utest"), MICROBIT_NO_DATA);
+        Checkpoint::remove("utest");
+        TEST_EQUAL(Checkpoint::restore(restored, "utest"), MICROBIT_NO_DATA);
+        
+        DPRINTF("Checkpoint: %d bytes, save %d us, unchanged %d us, restore %d us\r\n",
+            restored.state_size(), (int)save_us, (int)resave_us, (int)restore_us);
+    }
+    
+    /* Worst case time and transactions of one driver call */
+    typedef struct wcet_t
+    {
+        const char *name;
+        uint32_t max_us;
+        uint32_t max_transactions;
+    }Wcet;
+
+    #define WCET_RUNS 20
+    #define WCET_MEASURE(wcet, device, call) do { \
+        for(int run = 0; run < WCET_RUNS; run ++) { \
+            uint32_t before = (device).get_error_stats().transactions; \
+            uint64_t start_us = system_timer_current_time_us(); \
+            call; \
+            uint32_t took_us = system_timer_current_time_us() - start_us; \
+            uint32_t transactions = (device).get_error_stats().transactions - before; \
+            if(took_us > (wcet).max_us) (wcet).max_us = took_us; \
+            if(transactions > (wcet).max_transactions) (wcet).max_transactions = transactions; \
+        } } while(0)
+
+    void test_wcet()
+    {
+        PCA9685ServoController device;
+        const uint16_t values[UDRIVER_PCA9685_PIN_COUNT] = { 0 };
+        const uint16_t angles[4] = { 0, 450, 900, 1800 };
+        device.move_servo(Pin_P13, 90);
+        device.pwm_write_burst(Pin_P0, values, 1); //Auto increment is on from here
+
+        Wcet wcets[] = {
+            { "pwm_write", 0, 0 },
+            { "digital_write", 0, 0 },
+            { "pwm_pulse", 0, 0 },
+            { "move_servo", 0, 0 },
+            { "move_servos", 0, 0 },
+            { "pwm_write_burst", 0, 0 },
+            { "pwm_write_all", 0, 0 },
+            { "set_pwm_frequency", 0, 0 },
+        };
+        WCET_MEASURE(wcets[0], device, device.pwm_write(Pin_P0, run * 100));
+        WCET_MEASURE(wcets[1], device, device.digital_write(Pin_P1, run % 2));
+        WCET_MEASURE(wcets[2], device, device.pwm_pulse(Pin_P2, 1000 + run * 50));
+        WCET_MEASURE(wcets[3], device, device.move_servo(Pin_P13, run * 9));
+        WCET_MEASURE(wcets[4], device, device.move_servos(Pin_P12, angles, 4));
+        WCET_MEASURE(wcets[5], device, device.pwm_write_burst(Pin_P0, values, 16));
+        WCET_MEASURE(wcets[6], device, device.pwm_write_all(run * 100));
+        WCET_MEASURE(wcets[7], device, device.set_pwm_frequency(50 + run % 2));
+
+        for(unsigned i = 0; i < sizeof(wcets) / sizeof(Wcet); i ++)
+        {
+            DPRINTF("WCET: %s %d us, %d transactions\r\n", wcets[i].name,
+                (int)wcets[i].max_us, (int)wcets[i].max_transactions);
+        }
+
+        //Transaction counts documented in the README
+#if UDRIVER_PCA9685_REALTIME
+        TEST_EQUAL(wcets[0].max_transactions, 1);
+        TEST_EQUAL(wcets[1].max_transactions, 1);
+        TEST_EQUAL(wcets[2].max_transactions, 1);
+        TEST_EQUAL(wcets[3].max_transactions, 1);
+#else
+        TEST_EQUAL(wcets[0].max_transactions, 4);
+        TEST_EQUAL(wcets[1].max_transactions, 4);
+        TEST_EQUAL(wcets[2].max_transactions, 4);
+        TEST_EQUAL(wcets[3].max_transactions, 4);
+#endif
+        TEST_EQUAL(wcets[4].max_transactions, 1);
+        TEST_EQUAL(wcets[5].max_transactions, 1);
+        TEST_EQUAL(wcets[6].max_transactions, 4);
+        //Pulsed pins are P2, P12-P15
+#if UDRIVER_PCA9685_REALTIME
+        TEST_EQUAL(wcets[7].max_transactions, 3 + 5 * 1);
+#else
+        TEST_EQUAL(wcets[7].max_transactions, 4 + 5 * 4);
+#endif
+    }
+    
+    void test_channel_map()
+    {
+        PCA9685 device;
+        PCA9685 *devices[1] = { &device };
+        ChannelMap map(devices, 1);
+        const ChannelMapping table[] = {
+            { "left_knee", 0, Pin_P3 },
+            { "right_knee", 0, Pin_P0 },
+            { "strip_3[12]", 0, Pin_P1 },
+            { "strip_3[13]", 0, Pin_P2 },
+            { "eye", 0, Pin_P8 },
+        };
+        TEST_EQUAL(map.load(table, 5), MICROBIT_OK);
+        TEST_EQUAL(map.find("strip_3[12]"), 2);
+        TEST_EQUAL(map.find("tail"), -1);
+
+        //Scattered updates are grouped into runs of PWM Pins
+        const uint16_t channels[5] = { 0, 4, 1, 3, 2 };
+        const uint16_t values[5] = { 300, 800, 0, 200, 100 };
+        TEST_EQUAL(map.update(channels, values, 5), 2);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P3)), 300 & 0xFF);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P8)), 800 >> 8);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P2)), 200);
+        
+        //Gaps of written PWM Pins in the table are filled in
+        const uint16_t knees[2] = { 0, 1 };
+        TEST_EQUAL(map.update(knees, values, 2), 1);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P0)), 800 & 0xFF);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P1)), 100);
+
+        //Rebuilt at runtime; duplicate PWM Pins are refused
+        const ChannelMapping clash[] = { { "a", 0, Pin_P4 }, { "b", 0, Pin_P4 } };
+        TEST_EQUAL(map.load(clash, 2), MICROBIT_INVALID_PARAMETER);
+        TEST_EQUAL(map.find("left_knee"), -1);
+        TEST_EQUAL(map.load(table, 5), MICROBIT_OK);
+
+        //Benchmark: dispatch cost of 1000 channel updates in batches of 5
+        map.reset_stats();
+        for(int i = 0; i < 200; i ++) map.update(channels, values, 5);
+        const ChannelMapStats &stats = map.get_stats();
+        TEST_EQUAL(stats.updates, 1000);
+        DPRINTF("Channel map: per 1000 updates %d bursts, grouping %d us, bus %d us\r\n",
+            (int)stats.bursts, (int)stats.group_us, (int)stats.bus_us);
+
+        //A negative device count maps nothing
+        ChannelMap empty(devices, -1);
+        TEST_EQUAL(empty.load(table, 5), MICROBIT_INVALID_PARAMETER);
+
+        //Bursts sent before a failed one are still counted
+        PCA9685 missing;
+        ErrorPolicy policy = { 0, 0, false, false };
+        missing.set_error_policy(policy);
+        missing.address = 0x10;
+        PCA9685 *pair[2] = { &device, &missing };
+        ChannelMap split(pair, 2);
+        const ChannelMapping halves[] = { { "a", 0, Pin_P0 }, { "b", 1, Pin_P0 } };
+        TEST_EQUAL(split.load(halves, 2), MICROBIT_OK);
+        const uint16_t both[2] = { 0, 1 };
+        TEST_EQUAL((split.update(both, values, 2) != MICROBIT_OK), true);
+        TEST_EQUAL(split.get_stats().bursts, 1);
+    }
+
+    void test_channel_placement()
+    {
+        //Servos at 50 Hz and 330 Hz interleaved with LEDs
+        const ChannelRequirement rig[] = {
+            { "left_hip", Channel_Pulse, 50 },
+            { "status", Channel_Duty, 1000 },
+            { "left_knee", Channel_Pulse, 50 },
+            { "gimbal_pan", Channel_Pulse, 330 },
+            { "eye", Channel_Duty, 200 },
+            { "right_hip", Channel_Pulse, 50 },
+            { "warning", Channel_Duty, 1000 },
+            { "right_knee", Channel_Pulse, 50 },
+            { "gimbal_tilt", Channel_Pulse, 330 },
+            { "tail", Channel_Duty, 200 },
+        };
+        ChannelMapping mappings[10];
+        ChannelPlanner planner(3);
+        TEST_EQUAL(planner.plan(rig, 10, mappings), 3);
+        TEST_EQUAL(planner.get_frequency(0), 330);
+        TEST_EQUAL(planner.get_frequency(1), 50);
+        TEST_EQUAL(planner.get_frequency(2), 1000);
+        //LEDs needing 200 Hz share the 330 Hz PCA9685
+        TEST_EQUAL(mappings[4].device, 0);
+        TEST_EQUAL(mappings[4].pin, 2);
+        TEST_EQUAL(mappings[0].device, 1);
+        TEST_EQUAL(mappings[7].pin, 3);
+        TEST_EQUAL(mappings[6].device, 2);
+
+        //In the order given they would share one PCA9685 at 3 frequencies
+        const PlanStats &stats = planner.get_stats();
+        TEST_EQUAL(stats.naive_chips, 1);
+        TEST_EQUAL(stats.naive_conflicts, 1);
+#if UDRIVER_PCA9685_REALTIME
+        TEST_EQUAL(stats.avoided_transactions, 2 * (3 + 1 * 6));
+#else
+        TEST_EQUAL(stats.avoided_transactions, 2 * (4 + 4 * 6));
+#endif
+
+        //The layout loads into a ChannelMap; frequencies are set once
+        PCA9685 chip0, chip1, chip2; //All on the test PCA9685
+        PCA9685 *devices[3] = { &chip0, &chip1, &chip2 };
+        ChannelMap map(devices, 3);
+        TEST_EQUAL(map.load(mappings, 10), MICROBIT_OK);
+        TEST_EQUAL(planner.apply(devices), MICROBIT_OK);
+        TEST_EQUAL(chip1.get_pwm_frequency(), 50);
+        planner.report(mappings, 10);
+
+        //Three frequencies do not fit on two PCA9685s
+        ChannelPlanner small(2);
+        TEST_EQUAL(small.plan(rig, 10, mappings), MICROBIT_NO_RESOURCES);
+        const ChannelRequirement slow = { "slow", Channel_Pulse, 10 };
+        TEST_EQUAL(small.plan(&slow, 1, mappings), MICROBIT_INVALID_PARAMETER);
+    }
+
+    void test_motor_pair()
+    {
+        PCA9685 device;
+        //Sign-magnitude: one input PWMs, the other is held FULL OFF
+        MotorPair left(device, Pin_P0);
+        TEST_EQUAL(left.set_speed(-1000), MICROBIT_OK);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P0)), 0x10);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P1)), 1000 & 0xFF);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_H(Pin_P1)), 1000 >> 8);
+        TEST_EQUAL(left.brake(), MICROBIT_OK);
+        TEST_EQUAL(device.register_read(REG_ADDR_ON_H(Pin_P1)), 0x10);
+        TEST_EQUAL(left.set_speed(5000), MICROBIT_INVALID_PARAMETER);
+
+        //Complementary: 100 ticks between one input switching off and the
+        //other switching on, offset to tick 1024
+        MotorPair right(device, Pin_P2, Drive_Complementary, 100, 1024);
+        TEST_EQUAL(right.set_speed(0), MICROBIT_OK);
+        uint8_t regs[2 * UDRIVER_PCA9685_CHANNEL_BYTES];
+        right.encode(0, regs);
+        int a_on = regs[0] | (regs[1] << 8), a_off = regs[2] | (regs[3] << 8);
+        int b_on = regs[4] | (regs[5] << 8), b_off = regs[6] | (regs[7] << 8);
+        TEST_EQUAL(a_on, 1024);
+        TEST_EQUAL(a_off, 1024 + 2048 - 100);
+        TEST_EQUAL(b_on, 1024 + 2048);
+        TEST_EQUAL(b_off, 1024 - 100);
+        //Stopped means no net drive either way
+        TEST_EQUAL(a_off - a_on, (b_off - b_on + 4096) % 4096);
+        TEST_EQUAL(device.register_read(REG_ADDR_ON_L(Pin_P3)), (1024 + 2048) & 0xFF);
+        right.encode(UDRIVER_PCA9685_MOTOR_SPEED_MAX, regs);
+        TEST_EQUAL(regs[7], 0x10); //B FULL OFF
+
+        //A bank writes each run of consecutive pairs in one burst
+        MotorBank bank;
+        MotorPair arm(device, Pin_P6), wrist(device, Pin_P4), tail(device, Pin_P12);
+        TEST_EQUAL(bank.attach(&arm), 0);
+        TEST_EQUAL(bank.attach(&wrist), 1);
+        TEST_EQUAL(bank.attach(&tail), 2);
+        MotorPair clash(device, Pin_P5);
+        TEST_EQUAL(bank.attach(&clash), MICROBIT_INVALID_PARAMETER);
+        const int16_t speeds[3] = { 300, -200, 9000 };
+        TEST_EQUAL(bank.set_speeds(speeds), 2);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P6)), 300 & 0xFF);
+        TEST_EQUAL(device.register_read(REG_ADDR_OFF_L(Pin_P5)), 200);
+        TEST_EQUAL(tail.get_speed(), UDRIVER_PCA9685_MOTOR_SPEED_MAX);
+
+        //Benchmark: 100 updates of the bank
+        bank.reset_stats();
+        uint64_t start_us = system_timer_current_time_us();
+        for(int i = 0; i < 100; i ++) bank.set_speeds(speeds);
+        uint32_t elapsed_us = system_timer_current_time_us() - start_us;
+        TEST_EQUAL(bank.get_stats().bursts, 200);
+        DPRINTF("Motor bank: 100 updates of 3 pairs in %d us\r\n", (int)elapsed_us);
+    }
+
+#if UDRIVER_PCA9685_TRACING
+    void test_trace()
+    {
+        PCA9685ServoController device;
+        Trace::clear();
+        {
+            UDRIVER_PCA9685_TRACE_SCOPE("control_loop");
+            device.move_servo(Pin_P13, 45);
+        }
+
+        //Spans are recorded as they finish, innermost first
+        Trace::TraceEvent events[UDRIVER_PCA9685_TRACE_EVENTS];
+        int count = Trace::read(events, UDRIVER_PCA9685_TRACE_EVENTS);
+        //i2c spans, then pwm_write, pwm_pulse, move_servo and the loop
+#if UDRIVER_PCA9685_REALTIME
+        TEST_EQUAL(count, 1 + 1 + 4); //Through channel_write_burst
+#else
+        TEST_EQUAL(count, 4 + 4);
+#endif
+        TEST_EQUAL(strcmp(events[0].name, "i2c"), 0);
+        TEST_EQUAL(strcmp(events[count - 1].name, "control_loop"), 0);
+        TEST_EQUAL((events[0].start_us >= events[count - 1].start_us), true);
+        TEST_EQUAL((events[0].duration_us <= events[count - 1].duration_us), true);
+
+        //The ring keeps the newest events
+        for(int i = 0; i < UDRIVER_PCA9685_TRACE_EVENTS; i ++) device.pwm_write(Pin_P0, i);
+        TEST_EQUAL((Trace::lost() > 0), true);
+        TEST_EQUAL(Trace::read(events, UDRIVER_PCA9685_TRACE_EVENTS), UDRIVER_PCA9685_TRACE_EVENTS);
+        TEST_EQUAL(strcmp(events[UDRIVER_PCA9685_TRACE_EVENTS - 1].name, "pwm_write"), 0);
+
+        Trace::clear();
+        device.set_pwm_frequency(60);
+        Trace::dump();
+    }
+#endif
+    
     //%
     void unit_test()
     {
@@ -244,6 +1653,34 @@ namespace Test
         TEST(test_configure_servo);
         TEST(test_pwm_pulse_servo);
         TEST(test_move_servo);
+        TEST(test_output_enable);
+        TEST(test_pwm_write_burst);
+        TEST(test_bus_scheduler);
+        TEST(test_update_governor);
+        TEST(test_phase_allocator);
+        TEST(test_dither_engine);
+        TEST(test_brightness_map);
+        TEST(test_animator);
+        TEST(test_kernels);
+        TEST(test_bus_executor);
+        TEST(test_bus_locking);
+        TEST(test_mailbox);
+        TEST(test_error_policy);
+        TEST(test_scrubber);
+        TEST(test_servo_calibration);
+        TEST(test_power_manager);
+        TEST(test_radio_receiver);
+        TEST(test_serial_ingest);
+        TEST(test_async);
+        TEST(test_frame_daemon);
+        TEST(test_checkpoint);
+        TEST(test_wcet);
+        TEST(test_channel_map);
+        TEST(test_channel_placement);
+        TEST(test_motor_pair);
+#if UDRIVER_PCA9685_TRACING
+        TEST(test_trace);
+#endif
         TEST_END;
     }
         
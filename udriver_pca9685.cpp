@@ -4,262 +4,843 @@
 */
 
 #include "udriver_pca9685.h"
+#include "udriver_pca9685_gamma.h"
+#include "udriver_pca9685_calibration.h"
+#include "udriver_pca9685_kernels.h"
+#include "udriver_pca9685_checkpoint.h"
+#include "udriver_pca9685_trace.h"
 
 #undef printf
 #define PCA9685_PIN_MIN 0
 #define PCA9685_PIN_MAX 15
 
+#define REG_ADDR_MODE 0x0
+#define REG_ADDR_PRESCALE 0xFE
+#define MODE_DEFAULT 0x11 /* Sleep, respond to all call address */
+#define PRESCALE_DEFAULT 0x1E /* 200 Hz */
+/* Macros to determine control register address. Ref Datasheet */
+#define REG_ADDR_ON_L(pin) (pin * 4 + 0 + 6)
+#define REG_ADDR_ON_H(pin) (pin * 4 + 1 + 6)
+#define REG_ADDR_OFF_L(pin) (pin * 4 + 2 + 6)
+#define REG_ADDR_OFF_H(pin) (pin * 4 + 3 + 6)
+#define REG_ADDR_ALL_ON_L 0xFA
+#define REG_ADDR_ALL_ON_H 0xFB
+#define REG_ADDR_ALL_OFF_L 0xFC
+#define REG_ADDR_ALL_OFF_H 0xFD
+
+/* Return the status of a failed call from the calling function */
+#define CHECK(call) do { int check_status = (call); \
+    if(check_status != MICROBIT_OK) return check_status; } while(0)
+
+#if UDRIVER_PCA9685_LOCKING
+#define BUS_TRANSACTION() BusTransaction bus_transaction(*this->bus)
+#else
+#define BUS_TRANSACTION()
+#endif
+
 using namespace pxt;
 using namespace UDriver_PCA9685;
 
+//I2C Bus Class
+#if UDRIVER_PCA9685_REALTIME
+I2CBus::I2CBus(PinName sda, PinName scl) : sda(sda), scl(scl), i2c(sda, scl)
+#else
+I2CBus::I2CBus(PinName sda, PinName scl) : sda(sda), scl(scl)
+#endif
+{
+    static uint16_t next_lock_value = 1;
+    this->lock_value = next_lock_value ++;
+}
+
+void I2CBus::lock()
+{
+    //Fibers are cooperative, so the uncontended path needs no atomics
+    while(this->depth > 0 && this->owner != currentFiber)
+    {
+        this->waiters ++;
+        fiber_wait_for_event(UDRIVER_PCA9685_LOCK_EVT_ID, this->lock_value);
+        this->waiters --;
+    }
+    this->owner = currentFiber;
+    this->depth ++;
+}
+
+void I2CBus::unlock()
+{
+    if(this->depth == 0 || -- this->depth > 0) return;
+
+    this->owner = NULL;
+    if(this->waiters > 0) 
+        MicroBitEvent(UDRIVER_PCA9685_LOCK_EVT_ID, this->lock_value);
+}
+
+int I2CBus::clear()
+{
+    //Clock out a slave stuck mid byte until it releases SDA, then STOP
+    DigitalInOut sda(this->sda);
+    DigitalInOut scl(this->scl);
+    sda.input();
+    scl.output();
+    scl = 1;
+    for(int pulse = 0; pulse < 9 && sda.read() == 0; pulse ++)
+    {
+        scl = 0;
+        wait_us(5);
+        scl = 1;
+        wait_us(5);
+    }
+
+    sda.output();
+    sda = 0;
+    wait_us(5);
+    sda = 1;
+    wait_us(5);
+    sda.input();
+    scl.input();
+    return (sda.read() == 1) ? MICROBIT_OK : MICROBIT_I2C_ERROR;
+}
+
+I2CBus &I2CBus::primary()
+{
+    static I2CBus primary_bus(I2C_SDA0, I2C_SCL0);
+    return primary_bus;
+}
+
 //PCA9685 Class
-PCA9685::PCA9685(I2CAddress addr)
+PCA9685::PCA9685(I2CAddress addr, I2CBus &bus)
 {
     this->address = addr;
+    this->bus = &bus;
+    this->next_on_bus = bus.devices;
+    bus.devices = this;
+    this->cache_reset();
+    this->reset_error_stats();
+#if UDRIVER_PCA9685_REALTIME
+    //Turn on auto increment up front so no burst has to first
+    this->cache.mode |= (1 << Mode_AutoInc);
+    if(this->wake() == MICROBIT_OK) this->auto_inc = true;
+#else
     this->wake();
+#endif
 }
 
-void PCA9685::register_write(uint8_t addr, uint8_t value)
+PCA9685::~PCA9685()
 {
-    MicroBitI2C bus_i2c(I2C_SDA0, I2C_SCL0);
+    PCA9685 **link = &this->bus->devices;
+    while(*link != NULL && *link != this) link = &(*link)->next_on_bus;
+    if(*link != NULL) *link = this->next_on_bus;
+}
 
-    uint8_t packet[2] = { addr, value };
+I2CBus &PCA9685::get_bus()
+{
+    return *this->bus;
+}
+
+int PCA9685::i2c_transfer(I2CAddress address, const uint8_t *packet, int len, 
+        uint8_t *data, int data_len)
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("i2c");
+#if UDRIVER_PCA9685_REALTIME
+    MicroBitI2C &bus_i2c = this->bus->i2c;
+#else
+    MicroBitI2C bus_i2c(this->bus->sda, this->bus->scl);
+#endif
+
+    this->error_stats.transactions ++;
+    int status = bus_i2c.write(address, (const char *)packet, len);
+    if(status == MICROBIT_OK && data != NULL)
+        status = bus_i2c.read(address, (char *)data, data_len);
+    return status;
+}
+
+int PCA9685::transaction(const uint8_t *packet, int len, uint8_t *data, int data_len)
+{
+    return this->transaction(this->address, packet, len, data, data_len);
+}
+
+int PCA9685::transaction(I2CAddress address, const uint8_t *packet, int len, 
+        uint8_t *data, int data_len)
+{
+    int status = this->i2c_transfer(address, packet, len, data, data_len);
+    uint32_t backoff_us = this->error_policy.backoff_us;
+
+    for(int retry = 0; status != MICROBIT_OK && retry < this->error_policy.retries;
+            retry ++)
+    {
+        this->error_stats.failures ++;
+        if(backoff_us >= 1000) fiber_sleep(backoff_us / 1000);
+        else wait_us(backoff_us);
+        backoff_us *= 2;
+
+        status = this->i2c_transfer(address, packet, len, data, data_len);
+        if(status == MICROBIT_OK) this->error_stats.retried ++;
+    }
+    if(status == MICROBIT_OK) return MICROBIT_OK;
+    
+    this->error_stats.failures ++;
+    if(this->recovering) return status; //Reported by the transaction recovering
 
-    if(bus_i2c.write(this->address, (const char *)packet, sizeof(uint8_t) * 2) \
-            != MICROBIT_OK) 
+    if(this->error_policy.recover)
     {
-        uBit.serial.printf("Failed to write to PCA9685 register. Is the PCA9685 connected?");
+        if(this->recover() == MICROBIT_OK)
+        {
+            status = this->i2c_transfer(address, packet, len, data, data_len);
+            if(status == MICROBIT_OK) 
+            {
+                this->error_stats.recoveries ++;
+                return MICROBIT_OK;
+            }
+            this->error_stats.failures ++;
+        }
+    }
+
+    this->error_stats.errors ++;
+    if(this->error_handler != NULL) this->error_handler(*this, status);
+    if(this->error_policy.panic)
+    {
+        uBit.serial.printf("Failed to access PCA9685 register. Is the PCA9685 connected?");
         uBit.panic(UDRIVER_PCA9685_PANIC_CODE);
     }
+    return status;
+}
+
+int PCA9685::register_write(uint8_t addr, uint8_t value)
+{
+    BUS_TRANSACTION();
+    uint8_t packet[2] = { addr, value };
+
+    int status = this->transaction(packet, sizeof(uint8_t) * 2, NULL, 0);
+    if(status == MICROBIT_OK) this->cache_write(addr, &value, 1);
+    return status;
+}
+
+int PCA9685::register_write_burst(uint8_t addr, const uint8_t *data, int len)
+{
+    BUS_TRANSACTION();
+    uint8_t packet[1 + UDRIVER_PCA9685_PIN_COUNT * UDRIVER_PCA9685_CHANNEL_BYTES];
+    if(len <= 0 || len >= (int)sizeof(packet)) return MICROBIT_INVALID_PARAMETER;
+
+    if(!this->auto_inc)
+    {
+        //Bursts rely on the register pointer auto incrementing
+        CHECK(this->configure_mode(Mode_AutoInc, 1));
+        this->auto_inc = true;
+    }
+
+    packet[0] = addr;
+    memcpy(packet + 1, data, len);
+
+    int status = this->transaction(packet, len + 1, NULL, 0);
+    if(status == MICROBIT_OK) this->cache_write(addr, data, len);
+    return status;
+}
+
+int PCA9685::register_read(uint8_t addr, uint8_t *value)
+{
+    BUS_TRANSACTION();
+    int status = this->transaction(&addr, sizeof(uint8_t), value, sizeof(uint8_t));
+    if(status == MICROBIT_OK && addr == REG_ADDR_MODE) this->cache.mode = *value;
+    return status;
+}
+
+int PCA9685::register_read_burst(uint8_t addr, uint8_t *data, int len)
+{
+    BUS_TRANSACTION();
+    if(this->auto_inc) return this->transaction(&addr, sizeof(uint8_t), data, len);
+
+    //Without auto increment every register needs its own read
+    for(int i = 0; i < len; i ++, addr ++)
+        CHECK(this->transaction(&addr, sizeof(uint8_t), data + i, sizeof(uint8_t)));
+    return MICROBIT_OK;
 }
 
 uint8_t PCA9685::register_read(uint8_t addr)
 {
-    MicroBitI2C bus_i2c(I2C_SDA0, I2C_SCL0);
-    
-    uint8_t data;
-    if(bus_i2c.write(this->address, (char *)&addr, sizeof(uint8_t)) \
-            != MICROBIT_OK) 
+    uint8_t data = 0;
+    this->register_read(addr, &data);
+    return data;
+}
+
+void PCA9685::cache_reset()
+{
+    //Power on defaults. Ref Datasheet
+    this->cache.mode = MODE_DEFAULT;
+    this->cache.prescale = PRESCALE_DEFAULT;
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+        encode_channel(0, 0x1000, this->cache.channels + pin * UDRIVER_PCA9685_CHANNEL_BYTES);
+}
+
+void PCA9685::cache_write(uint8_t addr, const uint8_t *data, int len)
+{
+    for(int i = 0; i < len; i ++, addr ++)
     {
-        uBit.serial.printf("Failed to read from PCA9685 register. Is the PCA9685 connected?");
-        uBit.panic(UDRIVER_PCA9685_PANIC_CODE);
+        if(addr == REG_ADDR_MODE) this->cache.mode = data[i];
+        else if(addr == REG_ADDR_PRESCALE) this->cache.prescale = data[i];
+        else if(addr >= REG_ADDR_ON_L(0) && addr <= REG_ADDR_OFF_H(PCA9685_PIN_MAX))
+            this->cache.channels[addr - REG_ADDR_ON_L(0)] = data[i];
+        else if(addr >= REG_ADDR_ALL_ON_L && addr <= REG_ADDR_ALL_OFF_H)
+        {
+            for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+            {
+                this->cache.channels[pin * UDRIVER_PCA9685_CHANNEL_BYTES 
+                    + addr - REG_ADDR_ALL_ON_L] = data[i];
+            }
+        }
     }
+}
+
+int PCA9685::recover()
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("recover");
+    this->recovering = true;
+    int status = this->bus->clear();
+    if(status == MICROBIT_OK) status = this->restore_state();
+    this->recovering = false;
+    return status;
+}
+
+int PCA9685::restore_state()
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("restore_state");
+    BUS_TRANSACTION();
+    //Prescale can only be written while asleep, then wake with auto increment
+    uint8_t mode = this->cache.mode | (1 << Mode_AutoInc);
+    CHECK(this->register_write(REG_ADDR_MODE, (mode | (1 << Mode_Sleep)) & ~(1 << Mode_Restart)));
+    CHECK(this->register_write(REG_ADDR_PRESCALE, this->cache.prescale));
+    CHECK(this->register_write(REG_ADDR_MODE, mode & ~(1 << Mode_Restart)));
+    this->auto_inc = true;
+
+    uint8_t channels[sizeof(this->cache.channels)];
+    memcpy(channels, this->cache.channels, sizeof(channels));
+    return this->register_write_burst(REG_ADDR_ON_L(0), channels, sizeof(channels));
+}
+
+/* Serialized state: frequency, mode, prescale, pulse mode, channels, pulses */
+#define STATE_BYTES (2 + 1 + 1 + 2 + UDRIVER_PCA9685_PIN_COUNT * UDRIVER_PCA9685_CHANNEL_BYTES \
+    + UDRIVER_PCA9685_PIN_COUNT * 2)
+#define SERVO_STATE_BYTES (2 + UDRIVER_PCA9685_PIN_COUNT * 2 * 2)
+#define PUT_U16(data, value) do { (data)[0] = (value) & 0xFF; \
+    (data)[1] = (value) >> 8; } while(0)
+#define GET_U16(data) ((data)[0] | ((data)[1] << 8))
+
+int PCA9685::state_size()
+{
+    return STATE_BYTES;
+}
+
+int PCA9685::save_state(uint8_t *data)
+{
+    uint8_t *next = data;
+    PUT_U16(next, this->pwm_freq);
+    next += 2;
+    *next ++ = this->cache.mode;
+    *next ++ = this->cache.prescale;
+    PUT_U16(next, this->pulse_mode);
+    next += 2;
+    memcpy(next, this->cache.channels, sizeof(this->cache.channels));
+    next += sizeof(this->cache.channels);
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++, next += 2)
+        PUT_U16(next, this->pulse_len[pin]);
+    return next - data;
+}
+
+int PCA9685::load_state(const uint8_t *data, int len)
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("load_state");
+    if(len < STATE_BYTES) return MICROBIT_INVALID_PARAMETER;
 
-    if(bus_i2c.read(this->address, (char *)&data, sizeof(uint8_t)) \
-            != MICROBIT_OK) 
+    const uint8_t *next = data;
+    this->pwm_freq = GET_U16(next);
+    next += 2;
+    this->cache.mode = *next ++;
+    this->cache.prescale = *next ++;
+    this->pulse_mode = GET_U16(next);
+    next += 2;
+    memcpy(this->cache.channels, next, sizeof(this->cache.channels));
+    next += sizeof(this->cache.channels);
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++, next += 2)
+        this->pulse_len[pin] = GET_U16(next);
+    
+    this->prev_mode = this->cache.mode;
+    return this->restore_state();
+}
+
+#define MODE_VERIFY_MASK 0x7F /* RESTART reads back as set while running */
+int PCA9685::verify_mode()
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("verify_mode");
+    BUS_TRANSACTION();
+    uint8_t mode;
+    CHECK(this->register_read_burst(REG_ADDR_MODE, &mode, 1));
+    if((mode & MODE_VERIFY_MASK) == (this->cache.mode & MODE_VERIFY_MASK)) return 0;
+
+    //MODE1 only changes behind our back when the PCA9685 was reset, which
+    //loses every other register too
+    this->auto_inc = false;
+    CHECK(this->restore_state());
+    return 1;
+}
+
+int PCA9685::verify_channel(Pin pin)
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("verify_channel");
+    BUS_TRANSACTION();
+    uint8_t regs[UDRIVER_PCA9685_CHANNEL_BYTES];
+    const uint8_t *expected = this->cache.channels + pin * UDRIVER_PCA9685_CHANNEL_BYTES;
+    CHECK(this->register_read_burst(REG_ADDR_ON_L(pin), regs, sizeof(regs)));
+
+    int repaired = 0;
+    for(int i = 0; i < UDRIVER_PCA9685_CHANNEL_BYTES; i ++)
     {
-        uBit.serial.printf("Failed to read from PCA9685 register. Is the PCA9685 connected?");
-        uBit.panic(UDRIVER_PCA9685_PANIC_CODE);
+        if(regs[i] == expected[i]) continue;
+        CHECK(this->register_write(REG_ADDR_ON_L(pin) + i, expected[i]));
+        repaired ++;
     }
-    return data;
+    return repaired;
 }
 
-#define REG_ADDR_MODE 0x0
+void PCA9685::set_error_policy(const ErrorPolicy &policy)
+{
+    this->error_policy = policy;
+}
 
-void PCA9685::configure_mode(Mode setting, uint8_t value)
+const ErrorPolicy &PCA9685::get_error_policy()
 {
+    return this->error_policy;
+}
+
+void PCA9685::set_error_handler(ErrorHandler handler)
+{
+    this->error_handler = handler;
+}
+
+const ErrorStats &PCA9685::get_error_stats()
+{
+    return this->error_stats;
+}
+
+void PCA9685::reset_error_stats()
+{
+    memset(&this->error_stats, 0, sizeof(ErrorStats));
+}
+
+int PCA9685::configure_mode(Mode setting, uint8_t value)
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("configure_mode");
+    BUS_TRANSACTION();
     value = !!value; //Force value into 0 or 1
     
-    uint8_t mode_register = this->register_read(REG_ADDR_MODE);
+    uint8_t mode_register;
+#if UDRIVER_PCA9685_REALTIME
+    mode_register = this->cache.mode & ~(1 << Mode_Restart); //No hidden read
+#else
+    CHECK(this->register_read(REG_ADDR_MODE, &mode_register));
+#endif
     this->prev_mode = mode_register;
     //Change setting bit
     mode_register &= ~(1 << setting); //Unset Setting Bit
     mode_register |= (value << setting);  //Set setting bit if specified value
-    this->register_write(REG_ADDR_MODE, mode_register);
+    return this->register_write(REG_ADDR_MODE, mode_register);
 }
 
-void PCA9685::restore_mode()
+int PCA9685::restore_mode()
 {
-    this->register_write(REG_ADDR_MODE, this->prev_mode);
+    return this->register_write(REG_ADDR_MODE, this->prev_mode);
 }
 
-void PCA9685::software_reset()
+int PCA9685::software_reset()
 {
-    MicroBitI2C bus_i2c(I2C_SDA0, I2C_SCL0);
+    UDRIVER_PCA9685_TRACE_SCOPE("software_reset");
+    BUS_TRANSACTION();
     uint8_t swrst_code = 0x6;
-    bus_i2c.write(0x0, (char *)&swrst_code, sizeof(uint8_t));
+    int status = this->transaction(I2C_ADDRESS_GENERAL_CALL, &swrst_code, 
+        sizeof(uint8_t), NULL, 0);
+    
+    //Every PCA9685 on the bus is back to its power on defaults
+    for(PCA9685 *device = this->bus->devices; device != NULL; device = device->next_on_bus)
+    {
+        device->auto_inc = false;
+        device->cache_reset();
+    }
+    return status;
 }
-void PCA9685::sleep()
+
+int PCA9685::sleep()
 {
-    this->configure_mode(Mode_Sleep, 1);
+    UDRIVER_PCA9685_TRACE_SCOPE("sleep");
+    return this->configure_mode(Mode_Sleep, 1);
 }
 
-void PCA9685::wake()
+int PCA9685::wake()
 {
-    this->configure_mode(Mode_Sleep, 0);
+    UDRIVER_PCA9685_TRACE_SCOPE("wake");
+    return this->configure_mode(Mode_Sleep, 0);
 }
 
-/* Macros to determine control register address. Ref Datasheet */
-#define REG_ADDR_ON_L(pin) (pin * 4 + 0 + 6)
-#define REG_ADDR_ON_H(pin) (pin * 4 + 1 + 6)
-#define REG_ADDR_OFF_L(pin) (pin * 4 + 2 + 6)
-#define REG_ADDR_OFF_H(pin) (pin * 4 + 3 + 6)
-#define REG_ADDR_ALL_ON_L 0xFA
-#define REG_ADDR_ALL_ON_H 0xFB
-#define REG_ADDR_ALL_OFF_L 0xFC
-#define REG_ADDR_ALL_OFF_H 0xFD
+#define OSCILLATOR_STARTUP_US 500 /* Ref Datasheet */
+int PCA9685::restart()
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("restart");
+    BUS_TRANSACTION();
+    uint8_t mode;
+#if UDRIVER_PCA9685_REALTIME
+    //Without reading RESTART back, write it anyway as writing 1 while it
+    //reads 0 has no effect
+    mode = this->cache.mode | (1 << Mode_Restart);
+#else
+    CHECK(this->register_read_burst(REG_ADDR_MODE, &mode, 1));
+#endif
+    if(!(mode & (1 << Mode_Sleep))) return MICROBIT_OK;
 
-void PCA9685::digital_write(Pin pin, int value)
+    //Writing 0 to RESTART has no effect, so it stays pending until written 1
+    CHECK(this->register_write(REG_ADDR_MODE, mode & ~(1 << Mode_Sleep) & ~(1 << Mode_Restart)));
+    wait_us(OSCILLATOR_STARTUP_US);
+    if(mode & (1 << Mode_Restart))
+    {
+        CHECK(this->register_write(REG_ADDR_MODE, (mode & ~(1 << Mode_Sleep)) | (1 << Mode_Restart)));
+        this->cache.mode &= ~(1 << Mode_Restart); //Clears itself once restarted
+    }
+    return MICROBIT_OK;
+}
+
+int PCA9685::set_full_off(Pin pin, int value)
 {
-    if(value < 0 || value > 1) return;
-    
+    BUS_TRANSACTION();
+    if(value < 0 || value > 1) return MICROBIT_INVALID_PARAMETER;
+
+    uint8_t off_h = this->cache.channels[pin * UDRIVER_PCA9685_CHANNEL_BYTES + 3];
+    off_h = (value == 1) ? (off_h | 0x10) : (off_h & ~0x10);
+    return this->register_write(REG_ADDR_OFF_H(pin), off_h);
+}
+
+bool PCA9685::is_channel_off(Pin pin)
+{
+    const uint8_t *regs = this->cache.channels + pin * UDRIVER_PCA9685_CHANNEL_BYTES;
+    if(regs[3] & 0x10) return true; //FULL OFF takes precedence
+    if(regs[1] & 0x10) return false; //FULL ON
+    //Equal ON and OFF counts never switch the output on
+    return regs[0] == regs[2] && (regs[1] & 0x0F) == (regs[3] & 0x0F);
+}
+
+void PCA9685::clear_pulse_mode(uint16_t pins)
+{
+    this->pulse_mode &= ~pins;
+}
+
+void PCA9685::read_channel_cache(Pin pin, uint8_t *regs)
+{
+    memcpy(regs, this->cache.channels + pin * UDRIVER_PCA9685_CHANNEL_BYTES, 
+        UDRIVER_PCA9685_CHANNEL_BYTES);
+}
+
+int PCA9685::digital_write(Pin pin, int value)
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("digital_write");
+    BUS_TRANSACTION();
+    if(value < 0 || value > 1) return MICROBIT_INVALID_PARAMETER;
+
+#if UDRIVER_PCA9685_REALTIME
+    uint8_t regs[UDRIVER_PCA9685_CHANNEL_BYTES];
+    encode_channel((value == 1) ? 0x1000 : 0, (value == 1) ? 0 : 0x1000, regs);
+    return this->channel_write_burst(pin, regs, 1);
+#else
     if(value == 1)
     {
-        this->register_write(REG_ADDR_OFF_L(pin), 0x00);
-        this->register_write(REG_ADDR_OFF_H(pin), 0x00);
-        this->register_write(REG_ADDR_ON_L(pin), 0x00);
-        this->register_write(REG_ADDR_ON_H(pin), 0x10);
+        CHECK(this->register_write(REG_ADDR_OFF_L(pin), 0x00));
+        CHECK(this->register_write(REG_ADDR_OFF_H(pin), 0x00));
+        CHECK(this->register_write(REG_ADDR_ON_L(pin), 0x00));
+        CHECK(this->register_write(REG_ADDR_ON_H(pin), 0x10));
     }
     else
     {
-        this->register_write(REG_ADDR_ON_L(pin), 0x00);
-        this->register_write(REG_ADDR_ON_H(pin), 0x00);
-        this->register_write(REG_ADDR_OFF_L(pin), 0x00);
-        this->register_write(REG_ADDR_OFF_H(pin), 0x10);
+        CHECK(this->register_write(REG_ADDR_ON_L(pin), 0x00));
+        CHECK(this->register_write(REG_ADDR_ON_H(pin), 0x00));
+        CHECK(this->register_write(REG_ADDR_OFF_L(pin), 0x00));
+        CHECK(this->register_write(REG_ADDR_OFF_H(pin), 0x10));
     }
+    return MICROBIT_OK;
+#endif
 }
 
-void PCA9685::digital_write_all(int value)
+int PCA9685::digital_write_all(int value)
 {
+    UDRIVER_PCA9685_TRACE_SCOPE("digital_write_all");
+    BUS_TRANSACTION();
     if(value < 0 || value > 1)
-        return; 
+        return MICROBIT_INVALID_PARAMETER; 
 
     if(value == 1)
     {
-        this->register_write(REG_ADDR_ALL_OFF_L, 0x00);
-        this->register_write(REG_ADDR_ALL_OFF_H, 0x00);
-        this->register_write(REG_ADDR_ALL_ON_L, 0x00);
-        this->register_write(REG_ADDR_ALL_ON_H, 0x10);
+        CHECK(this->register_write(REG_ADDR_ALL_OFF_L, 0x00));
+        CHECK(this->register_write(REG_ADDR_ALL_OFF_H, 0x00));
+        CHECK(this->register_write(REG_ADDR_ALL_ON_L, 0x00));
+        CHECK(this->register_write(REG_ADDR_ALL_ON_H, 0x10));
     }
     
     else
     {
         //Write default value
-        this->register_write(REG_ADDR_ALL_ON_L, 0x00);
-        this->register_write(REG_ADDR_ALL_ON_H, 0x10);
-        this->register_write(REG_ADDR_ALL_OFF_L, 0x00);
-        this->register_write(REG_ADDR_ALL_OFF_H, 0x10);
+        CHECK(this->register_write(REG_ADDR_ALL_ON_L, 0x00));
+        CHECK(this->register_write(REG_ADDR_ALL_ON_H, 0x10));
+        CHECK(this->register_write(REG_ADDR_ALL_OFF_L, 0x00));
+        CHECK(this->register_write(REG_ADDR_ALL_OFF_H, 0x10));
     }
 
     this->pulse_mode = 0;
+    return MICROBIT_OK;
 }
 
-void PCA9685::pwm_write(Pin pin, int value)
+int PCA9685::pwm_write(Pin pin, int value)
 {
+    UDRIVER_PCA9685_TRACE_SCOPE("pwm_write");
+    BUS_TRANSACTION();
     if(value < UDRIVER_PCA9685_PWM_MIN || value > UDRIVER_PCA9685_PWM_MAX)
-        return;
+        return MICROBIT_INVALID_PARAMETER;
 
+#if UDRIVER_PCA9685_REALTIME
+    uint8_t regs[UDRIVER_PCA9685_CHANNEL_BYTES];
+    encode_channel(0, value, regs);
+    return this->channel_write_burst(pin, regs, 1);
+#else
     //ON Register
-    this->register_write(REG_ADDR_ON_L(pin), 0x00);
-    this->register_write(REG_ADDR_ON_H(pin), 0x00);
+    CHECK(this->register_write(REG_ADDR_ON_L(pin), 0x00));
+    CHECK(this->register_write(REG_ADDR_ON_H(pin), 0x00));
 
     uint8_t off_lsb = (value & 0xFF); //Get least significant 8 bits
     value >>= 8;
     uint8_t off_hsb = (value & 0x0F); //Get most significant 4 bits
     
     //OFF Register
-    this->register_write(REG_ADDR_OFF_L(pin), off_lsb);
-    this->register_write(REG_ADDR_OFF_H(pin), off_hsb);
-    
+    CHECK(this->register_write(REG_ADDR_OFF_L(pin), off_lsb));
+    return this->register_write(REG_ADDR_OFF_H(pin), off_hsb);
+#endif
 }
 
-void PCA9685::pwm_write_all(int value)
+int PCA9685::pwm_write_all(int value)
 {
+    UDRIVER_PCA9685_TRACE_SCOPE("pwm_write_all");
+    BUS_TRANSACTION();
     if(value < UDRIVER_PCA9685_PWM_MIN || value > UDRIVER_PCA9685_PWM_MAX)
-        return; 
+        return MICROBIT_INVALID_PARAMETER; 
 
     if(value == 0)
     {
         //Write default value
-        this->register_write(REG_ADDR_ALL_ON_L, 0x00);
-        this->register_write(REG_ADDR_ALL_ON_H, 0x10);
-        this->register_write(REG_ADDR_ALL_OFF_L, 0x00);
-        this->register_write(REG_ADDR_ALL_OFF_H, 0x10);
+        CHECK(this->register_write(REG_ADDR_ALL_ON_L, 0x00));
+        CHECK(this->register_write(REG_ADDR_ALL_ON_H, 0x10));
+        CHECK(this->register_write(REG_ADDR_ALL_OFF_L, 0x00));
+        CHECK(this->register_write(REG_ADDR_ALL_OFF_H, 0x10));
     }
     else
     {
         //ON Register
-        this->register_write(REG_ADDR_ALL_ON_L, 0x00);
-        this->register_write(REG_ADDR_ALL_ON_H, 0x00);
+        CHECK(this->register_write(REG_ADDR_ALL_ON_L, 0x00));
+        CHECK(this->register_write(REG_ADDR_ALL_ON_H, 0x00));
 
         uint8_t off_lsb = (value & 0xFF); //Get least significant 8 bits
         value >>= 8;
         uint8_t off_hsb = (value & 0x0F); //Get most significant 4 bits
         
         //OFF Register
-        this->register_write(REG_ADDR_ALL_OFF_L, off_lsb);
-        this->register_write(REG_ADDR_ALL_OFF_H, off_hsb);
+        CHECK(this->register_write(REG_ADDR_ALL_OFF_L, off_lsb));
+        CHECK(this->register_write(REG_ADDR_ALL_OFF_H, off_hsb));
 
     }
 
     this->pulse_mode = 0;
+    return MICROBIT_OK;
 }
  
-void PCA9685::pwm_pulse(Pin pin, int pulse_us)
+void PCA9685::encode_channel(int on, int off, uint8_t *regs)
+{
+    regs[0] = (on & 0xFF); //ON least significant 8 bits
+    regs[1] = ((on >> 8) & 0x1F); //ON most significant 4 bits + FULL ON
+    regs[2] = (off & 0xFF); //OFF least significant 8 bits
+    regs[3] = ((off >> 8) & 0x1F); //OFF most significant 4 bits + FULL OFF
+}
+
+int PCA9685::pwm_write_burst(Pin pin, const uint16_t *values, int count)
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("pwm_write_burst");
+    uint8_t regs[UDRIVER_PCA9685_PIN_COUNT * UDRIVER_PCA9685_CHANNEL_BYTES];
+    if(count <= 0 || pin + count > UDRIVER_PCA9685_PIN_COUNT) 
+        return MICROBIT_INVALID_PARAMETER;
+
+    for(int i = 0; i < count; i ++)
+    {
+        int value = (values[i] > UDRIVER_PCA9685_PWM_MAX) ? 0 : values[i];
+        encode_channel(0, value, regs + i * UDRIVER_PCA9685_CHANNEL_BYTES);
+    }
+
+    return this->channel_write_burst(pin, regs, count);
+}
+
+int PCA9685::channel_write_burst(Pin pin, const uint8_t *regs, int count)
 {
-    //Time per PWM division in microseconds.      | ms      | us
-    double tick = (double) (1.0 / this->pwm_freq) * 1000.0 * 1000.0 / 4095.0;
-    int pwm_pulse = round((double) pulse_us / tick);
+    UDRIVER_PCA9685_TRACE_SCOPE("channel_write_burst");
+    if(count <= 0 || pin + count > UDRIVER_PCA9685_PIN_COUNT) 
+        return MICROBIT_INVALID_PARAMETER;
+
+    return this->register_write_burst(REG_ADDR_ON_L(pin), regs, 
+        count * UDRIVER_PCA9685_CHANNEL_BYTES);
+}
+
+int PCA9685::pwm_pulse(Pin pin, int pulse_us)
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("pwm_pulse");
+    BUS_TRANSACTION();
+    return this->pwm_write(pin, this->prepare_pulse(pin, pulse_us));
+}
+
+int PCA9685::prepare_pulse(Pin pin, int pulse_us)
+{
+    //A pulse must fit in one PWM period
+    if(pulse_us < 0 || pulse_us > (int)(1000000L / this->pwm_freq)) 
+        return MICROBIT_INVALID_PARAMETER;
+
+    //Same exact rounding as bulk conversions. Dividing by the PWM division
+    //time in double put halves, like 2000us at 50Hz, on either side
+    uint16_t pulses[1] = { (uint16_t)pulse_us };
+    uint16_t values[1];
+    Kernels::pulses_to_values(pulses, values, 1, this->pwm_freq);
+    int pwm_pulse = values[0];
     
     this->pulse_len[pin] = pulse_us;
     this->pulse_mode |= (1 << pin); //Mark that this pin operates in pulse mode
-    
-    this->pwm_write(pin, pwm_pulse);
+    return pwm_pulse;
 }
 
-#define REG_ADDR_PRESCALE 0xFE
+#if UDRIVER_PCA9685_REALTIME
+#define PRESCALE_VALUE(freq) ((25000000L + 2048L * (freq)) / (4096L * (freq)) - 1)
+#else
 #define PRESCALE_VALUE(freq) (round(25000000.0/(4096.0 * (double)freq)) - 1)
-void PCA9685::set_pwm_frequency(int frequency)
+#endif
+int PCA9685::set_pwm_frequency(int frequency)
 {
-    if(PRESCALE_VALUE(frequency) < 0x03 || PRESCALE_VALUE(frequency) > 0xFF)
-        return;
+    UDRIVER_PCA9685_TRACE_SCOPE("set_pwm_frequency");
+    BUS_TRANSACTION();
+    if(frequency <= 0 || PRESCALE_VALUE(frequency) < 0x03 || PRESCALE_VALUE(frequency) > 0xFF)
+        return MICROBIT_INVALID_PARAMETER;
     
-    this->sleep();
-    this->register_write(REG_ADDR_PRESCALE, PRESCALE_VALUE(frequency));
-    this->restore_mode();
+    CHECK(this->sleep());
+    CHECK(this->register_write(REG_ADDR_PRESCALE, PRESCALE_VALUE(frequency)));
+    CHECK(this->restore_mode());
     this->pwm_freq = frequency;
     //Reconfigure PWM ticks based on new PWM frequency 
     for(int pin = PCA9685_PIN_MIN; pin <= PCA9685_PIN_MAX; pin ++)
     {
         if(this->pulse_mode & (1UL << pin))
         {
-            this->pwm_pulse((Pin)pin, this->pulse_len[pin]);
+            CHECK(this->pwm_pulse((Pin)pin, this->pulse_len[pin]));
         }
     }
+    return MICROBIT_OK;
+}
+
+int PCA9685::get_pwm_frequency()
+{
+    return this->pwm_freq;
 }
 
 #define REG_ADDR_ACALL 0x05
 #define REG_ADDR_SUB(n) (0x01 +  n)
-void PCA9685::change_address(I2CAddress addr)
+int PCA9685::change_address(I2CAddress addr)
 {
-    if(addr <= 0x07 || addr >= 0xF0) return; //Reject Reserved Addresses
-    this->configure_mode(Mode_AllCall_Addr, 1);
-    this->register_write(REG_ADDR_ACALL, addr);
+    BUS_TRANSACTION();
+    if(addr <= 0x07 || addr >= 0xF0) return MICROBIT_INVALID_PARAMETER; //Reject Reserved Addresses
+    CHECK(this->configure_mode(Mode_AllCall_Addr, 1));
+    CHECK(this->register_write(REG_ADDR_ACALL, addr));
     this->address = addr;
+    return MICROBIT_OK;
 }
 
-void PCA9685::add_alt_address(I2CAddress addr)
+int PCA9685::add_alt_address(I2CAddress addr)
 {
-    if(addr <= 0x07 || addr >= 0xF0) return; //Reject Reserved Addresses
+    BUS_TRANSACTION();
+    if(addr <= 0x07 || addr >= 0xF0) return MICROBIT_INVALID_PARAMETER; //Reject Reserved Addresses
     this->sub_addr = (this->sub_addr + 1) % 4;
 
-    if(this->sub_addr == 1) this->configure_mode(Mode_SubCall1_Addr, 1);
-    if(this->sub_addr == 2) this->configure_mode(Mode_SubCall2_Addr, 1);
-    if(this->sub_addr == 3) this->configure_mode(Mode_SubCall3_Addr, 1);
-    this->register_write(REG_ADDR_SUB(this->sub_addr), addr);
+    if(this->sub_addr == 1) CHECK(this->configure_mode(Mode_SubCall1_Addr, 1));
+    if(this->sub_addr == 2) CHECK(this->configure_mode(Mode_SubCall2_Addr, 1));
+    if(this->sub_addr == 3) CHECK(this->configure_mode(Mode_SubCall3_Addr, 1));
+    return this->register_write(REG_ADDR_SUB(this->sub_addr), addr);
 }
 
-//PCA9685 Servo Controller Class
-PCA9685ServoController::PCA9685ServoController(I2CAddress addr)
+//Output Enable
+MicroBitOutputEnablePin::MicroBitOutputEnablePin(MicroBitPin &pin, int period_us)
+    : pin(pin), period_us(period_us)
 {
-    this->address = addr;
-    this->wake();
+}
+
+void MicroBitOutputEnablePin::write_digital(int value)
+{
+    this->pin.setDigitalValue(!!value);
+}
+
+void MicroBitOutputEnablePin::write_analog(int value)
+{
+    //Period can only be set once the pin is in analog mode
+    this->pin.setAnalogValue(value);
+    this->pin.setAnalogPeriodUs(this->period_us);
+}
+
+void PCA9685::attach_output_enable(OutputEnablePin *oe)
+{
+    if(this->output_enable != NULL && oe == NULL)
+        this->output_enable->write_digital(0); //Leave outputs enabled
+
+    this->output_enable = oe;
+    if(oe != NULL) this->apply_output_enable();
+}
 
+void PCA9685::apply_output_enable()
+{
+    //NOTE: /OE is active low: HIGH disables all outputs
+    if(this->blanked || this->oe_level == 0)
+        this->output_enable->write_digital(1);
+    else if(this->oe_level >= 1023)
+        this->output_enable->write_digital(0);
+    else
+        this->output_enable->write_analog(1023 - this->oe_level);
+}
+
+void PCA9685::blank()
+{
+    if(this->output_enable == NULL)
+    {
+        this->digital_write_all(0);
+        return;
+    }
+
+    this->blanked = true;
+    this->apply_output_enable();
+}
+
+void PCA9685::unblank()
+{
+    this->blanked = false;
+    if(this->output_enable != NULL) this->apply_output_enable();
+}
+
+void PCA9685::dim(int level)
+{
+    if(level < 0 || level > 1023) return;
+
+    this->oe_level = level;
+    if(this->output_enable != NULL) this->apply_output_enable();
+}
+
+//PCA9685 Servo Controller Class
+PCA9685ServoController::PCA9685ServoController(I2CAddress addr, I2CBus &bus)
+    : PCA9685(addr, bus)
+{
     //Set default values
+    this->servo_mode = 0;
     for(int pin = PCA9685_PIN_MIN; pin <= PCA9685_PIN_MAX; pin ++)
     {
         this->pulse_min[pin] = 1000; //1000 usec
         this->pulse_max[pin] = 2000; //2000 usec
+        this->calibration[pin] = NULL;
     }
     
     this->set_pwm_frequency(50); //50 H4
@@ -271,7 +852,28 @@ void PCA9685ServoController::configure_servo(Pin pin, int min_us, int max_us)
     this->pulse_min[pin] = min_us;
 }
 
-void PCA9685ServoController::pwm_pulse(Pin pin, int pulse_us)
+void PCA9685ServoController::calibrate_servo(Pin pin, 
+        const ServoCalibration *calibration)
+{
+    this->calibration[pin] = calibration;
+    if(calibration != NULL) 
+        this->configure_servo(pin, calibration->min_pulse(), calibration->max_pulse());
+}
+
+int PCA9685ServoController::servo_pulse(Pin pin, int angle)
+{
+    angle = (angle < 0) ? 0 : angle;
+    angle = (angle > UDRIVER_PCA9685_ANGLE_MAX) ? UDRIVER_PCA9685_ANGLE_MAX : angle;
+
+    if(this->calibration[pin] != NULL) return this->calibration[pin]->pulse(angle);
+    
+    //Linear between the configured pulses
+    int range = this->pulse_max[pin] - this->pulse_min[pin];
+    return this->pulse_min[pin] + (range * angle + UDRIVER_PCA9685_ANGLE_MAX / 2) 
+        / UDRIVER_PCA9685_ANGLE_MAX;
+}
+
+int PCA9685ServoController::prepare_pulse(Pin pin, int pulse_us)
 {
     if(this->servo_mode & (1UL << pin))
     {
@@ -281,18 +883,87 @@ void PCA9685ServoController::pwm_pulse(Pin pin, int pulse_us)
             : pulse_us;
     }
     
-    PCA9685::pwm_pulse(pin, pulse_us);
+    return PCA9685::prepare_pulse(pin, pulse_us);
+}
+
+int PCA9685ServoController::prepare_servo(Pin pin, int angle)
+{
+    this->servo_mode |= (1 << pin); //Mark this pin as servo pin.
+    return this->prepare_pulse(pin, this->servo_pulse(pin, angle));
+}
+
+int PCA9685ServoController::state_size()
+{
+    return PCA9685::state_size() + SERVO_STATE_BYTES;
 }
 
-void PCA9685ServoController::move_servo(Pin pin, double angle_deg)
+int PCA9685ServoController::save_state(uint8_t *data)
 {
+    uint8_t *next = data + PCA9685::save_state(data);
+    PUT_U16(next, this->servo_mode);
+    next += 2;
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++, next += 4)
+    {
+        PUT_U16(next, this->pulse_min[pin]);
+        PUT_U16(next + 2, this->pulse_max[pin]);
+    }
+    return next - data;
+}
+
+int PCA9685ServoController::load_state(const uint8_t *data, int len)
+{
+    if(len < this->state_size()) return MICROBIT_INVALID_PARAMETER;
+
+    const uint8_t *next = data + PCA9685::state_size();
+    this->servo_mode = GET_U16(next);
+    next += 2;
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++, next += 4)
+    {
+        this->pulse_min[pin] = GET_U16(next);
+        this->pulse_max[pin] = GET_U16(next + 2);
+        this->calibration[pin] = NULL;
+    }
+    return PCA9685::load_state(data, PCA9685::state_size());
+}
+
+int PCA9685ServoController::move_servo(Pin pin, double angle_deg)
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("move_servo");
     angle_deg = (angle_deg > 180.0) ? 180.0 : angle_deg;
     angle_deg = (angle_deg < 0.0) ? 0.0 : angle_deg;
 
-    int pulse_us = round((angle_deg / 180.0) * (2000.0 - 1000.0) + 1000.0);
+    int pulse_us = this->servo_pulse(pin, round(angle_deg * 10.0));
     
     this->servo_mode |=  (1 << pin); //Mark this pin as servo pin.
-    this->pwm_pulse(pin, pulse_us);
+    return this->pwm_pulse(pin, pulse_us);
+}
+
+int PCA9685ServoController::move_servos(Pin pin, const uint16_t *angles, int count)
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("move_servos");
+    uint16_t pulses[UDRIVER_PCA9685_PIN_COUNT];
+    uint16_t values[UDRIVER_PCA9685_PIN_COUNT];
+    if(count <= 0 || pin + count > UDRIVER_PCA9685_PIN_COUNT) 
+        return MICROBIT_INVALID_PARAMETER;
+
+    for(int i = 0; i < count; i ++)
+    {
+        int servo = pin + i;
+        int pulse_us = this->servo_pulse((Pin)servo, angles[i]);
+        //Clamp like pwm_pulse() does for servo pins
+        pulse_us = (pulse_us < this->pulse_min[servo]) ? this->pulse_min[servo] 
+            : pulse_us;
+        pulse_us = (pulse_us > this->pulse_max[servo]) ? this->pulse_max[servo] 
+            : pulse_us;
+        
+        pulses[i] = pulse_us;
+        this->pulse_len[servo] = pulse_us;
+        this->pulse_mode |= (1 << servo);
+        this->servo_mode |= (1 << servo); //Mark this pin as servo pin.
+    }
+    
+    Kernels::pulses_to_values(pulses, values, count, this->pwm_freq);
+    return this->pwm_write_burst(pin, values, count);
 }
 
 //Functional Callbacks for makecode package
@@ -307,15 +978,31 @@ namespace UDriver_PCA9685
     void pwm_write(int pin, int value){ pca_device->pwm_write((Pin)pin, value); }
     //%
     void pwm_write_all(int value){ pca_device->pwm_write_all(value); }
+    static BrightnessMap *brightness_map = new BrightnessMap;
+    static uint16_t curved_pins = 0; /* PWM Pins given a curve other than linear */
     //%
     void analog_write(int pin, int value){ 
-        int pwm_value = (int)((double) value / 1023.0 * 4095.0);
-        pwm_write(pin, pwm_value);
+        if(value < 0 || value > UDRIVER_PCA9685_BRIGHTNESS_MAX) return;
+        if(curved_pins & (1 << pin))
+            pwm_write(pin, brightness_map->map((Pin)pin, value));
+        else
+            pwm_write(pin, (int)((double) value / 1023.0 * 4095.0));
     }
     //%
     void analog_write_all(int value){ 
-        int pwm_value = (int)((double) value / 1023.0 * 4095.0);
-        pwm_write_all(pwm_value);
+        if(value < 0 || value > UDRIVER_PCA9685_BRIGHTNESS_MAX) return;
+        pwm_write_all((int)((double) value / 1023.0 * 4095.0));
+        for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+        {
+            if(curved_pins & (1 << pin)) 
+                pwm_write(pin, brightness_map->map((Pin)pin, value));
+        }
+    }
+    //%
+    void set_brightness_curve(int pin, int curve){ 
+        brightness_map->set_curve((Pin)pin, (BrightnessCurve)curve); 
+        if(curve == Curve_Linear) curved_pins &= ~(1 << pin);
+        else curved_pins |= (1 << pin);
     }
     //%
     void pwm_pulse(int pin, int pulse_us) { pca_device->pwm_pulse((Pin)pin, pulse_us); }
@@ -331,4 +1018,28 @@ namespace UDriver_PCA9685
     void move_servo(int pin, int angle_deg){ pca_device->move_servo((Pin)pin, angle_deg);}
     //%
     void configure_servo(int pin, int min, int max){ pca_device->configure_servo((Pin)pin, min, max); }
+    //%
+    void attach_output_enable(int pin){ 
+        static MicroBitOutputEnablePin *oe_pin = NULL;
+        MicroBitOutputEnablePin *prev_pin = oe_pin;
+        oe_pin = new MicroBitOutputEnablePin(*getPin(pin));
+        pca_device->attach_output_enable(oe_pin);
+        delete prev_pin;
+    }
+    //%
+    void set_error_panic(int panic){ 
+        ErrorPolicy policy = pca_device->get_error_policy();
+        policy.panic = !!panic;
+        pca_device->set_error_policy(policy);
+    }
+    //%
+    void blank(){ pca_device->blank(); }
+    //%
+    void unblank(){ pca_device->unblank(); }
+    //%
+    void dim(int level){ pca_device->dim(level); }
+    //%
+    void save_state(){ Checkpoint::save(*pca_device, "pca9685"); }
+    //%
+    bool restore_state(){ return Checkpoint::restore(*pca_device, "pca9685") == MICROBIT_OK; }
 }
@@ -6,6 +6,22 @@
 #define UDRIVER_PCA9685_PANIC_CODE 90
 #define UDRIVER_PCA9685_PWM_MAX 4095
 #define UDRIVER_PCA9685_PWM_MIN 0 
+#define UDRIVER_PCA9685_PIN_COUNT 16
+#define UDRIVER_PCA9685_CHANNEL_BYTES 4 /* LEDn_ON_L, ON_H, OFF_L, OFF_H */
+#define UDRIVER_PCA9685_LOCK_EVT_ID 9686 /* Message bus id for bus locks */
+
+/* Set to 0 to compile out per bus locking of PCA9685 transactions */
+#ifndef UDRIVER_PCA9685_LOCKING
+#define UDRIVER_PCA9685_LOCKING 1
+#endif
+
+/* Set to 1 for the real-time profile: no floating point, no reads hidden in
+ * writes, one i2c object per bus, single burst channel writes and a default
+ * error policy that neither retries nor panics, so that every call makes a
+ * bounded number of transactions. See the README for the counts. */
+#ifndef UDRIVER_PCA9685_REALTIME
+#define UDRIVER_PCA9685_REALTIME 0
+#endif
 namespace UDriver_PCA9685 
 {
     typedef uint8_t I2CAddress;
@@ -45,86 +61,369 @@ namespace UDriver_PCA9685
     }Mode;
 
     const I2CAddress I2C_ADDRESS_ALL_CALL = 0xE0;
-    
-    /* Represents an PCA9685 */
+    const I2CAddress I2C_ADDRESS_GENERAL_CALL = 0x00;
+
+    class PCA9685;
+
+    /* Represents an i2c bus, given by its SDA and SCL pins, that one or more
+     * PCA9685s are attached to */
+    class I2CBus
+    {
+    public:
+        I2CBus(PinName sda, PinName scl);
+
+        /* The MicroBit's i2c port, used unless another bus is given */
+        static I2CBus &primary();
+
+        /* Take the bus, waiting while another fiber holds it. A fiber may
+         * take the bus again while holding it. Must not be called from an
+         * interrupt. */
+        void lock();
+
+        /* Release the bus, once for every lock() */
+        void unlock();
+
+        /* Free a slave holding SDA low by clocking SCL, then send a STOP.
+         * Returns MICROBIT_OK or MICROBIT_I2C_ERROR if SDA is still held. */
+        int clear();
+
+        PinName sda;
+        PinName scl;
+#if UDRIVER_PCA9685_REALTIME
+        MicroBitI2C i2c; /* Built once instead of for every transaction */
+#endif
+
+    protected:
+        Fiber *owner = NULL;
+        uint16_t depth = 0;
+        uint16_t waiters = 0;
+        uint16_t lock_value; /* Event value raised when the bus is released */
+        PCA9685 *devices = NULL; /* PCA9685s on the bus, for software_reset() */
+
+        friend class PCA9685;
+    };
+
+    /* Holds an i2c bus for as long as it is in scope, grouping the 
+     * transactions made meanwhile into one logical update */
+    class BusTransaction
+    {
+    public:
+        BusTransaction(I2CBus &bus) : bus(bus) { bus.lock(); }
+        ~BusTransaction() { bus.unlock(); }
+
+    protected:
+        I2CBus &bus;
+    };
+
+    /* Abstracts the GPIO wired to the PCA9685's active low /OE pin, so that
+     * the output enable fast path can run against a stand-in off target.
+    */
+    class OutputEnablePin
+    {
+    public:
+        /* Drive the /OE pin LOW (0) or HIGH (1) */
+        virtual void write_digital(int value) = 0;
+
+        /* Drive a software PWM on the /OE pin with a HIGH duty of 0-1023 */
+        virtual void write_analog(int value) = 0;
+    };
+
+    /* OutputEnablePin backed by one of the MicroBit's GPIO pins */
+    class MicroBitOutputEnablePin : public OutputEnablePin
+    {
+    public:
+        /* Use the given MicroBit pin, dimming with a software PWM of the
+         * given period in microseconds */
+        MicroBitOutputEnablePin(MicroBitPin &pin, int period_us=1000);
+
+        virtual void write_digital(int value);
+        virtual void write_analog(int value);
+
+    protected:
+        MicroBitPin &pin;
+        int period_us;
+    };
+
+    /* Defines how a PCA9685 handles failed i2c transactions */
+    typedef struct error_policy_t
+    {
+        uint8_t retries; /* Extra attempts after a failed transaction */
+        uint16_t backoff_us; /* Wait before the first retry, doubling after */
+        bool recover; /* Clear the bus and restore the PCA9685 from cache */
+        bool panic; /* Panic if the transaction still fails */
+    }ErrorPolicy;
+
+#if UDRIVER_PCA9685_REALTIME
+    /* Fail fast, leaving the caller to handle the error within its budget */
+    const ErrorPolicy ERROR_POLICY_DEFAULT = { 0, 0, false, false };
+#else
+    /* By default retry twice, then recover, then panic as before */
+    const ErrorPolicy ERROR_POLICY_DEFAULT = { 2, 100, true, true };
+#endif
+
+    /* Counters of failed i2c transactions on a PCA9685 */
+    typedef struct error_stats_t
+    {
+        uint32_t transactions; /* Attempts made, including retries */
+        uint32_t failures; /* Failed attempts, including retries */
+        uint32_t retried; /* Transactions that succeeded on a retry */
+        uint32_t recoveries; /* Transactions that succeeded after recovery */
+        uint32_t errors; /* Transactions given up on */
+    }ErrorStats;
+
+    /* Called with the status of each transaction given up on */
+    typedef void (*ErrorHandler)(PCA9685 &device, int status);
+
+    /* Represents an PCA9685 
+     * Methods returning int return MICROBIT_OK on success, 
+     * MICROBIT_INVALID_PARAMETER for invalid arguments or the i2c error 
+     * of a transaction that failed under the error policy.
+    */
     class PCA9685
     {
     public:
         /* Construct a new instance of PCA9685 for the optional i2c address
          * If no i2c address is given would use all call address
+         * If no i2c bus is given would use the MicroBit's i2c port
         */
-        PCA9685(I2CAddress addr=I2C_ADDRESS_ALL_CALL);
+        PCA9685(I2CAddress addr=I2C_ADDRESS_ALL_CALL, I2CBus &bus=I2CBus::primary());
+        virtual ~PCA9685();
+
+        /* i2c bus the PCA9685 is attached to */
+        I2CBus &get_bus();
 
         /* digital write 0 or 1 to the given PWM Pin on the PCA9685 */
-        void digital_write(Pin pin, int value);
+        int digital_write(Pin pin, int value);
 
         /* digital write 0 or 1 to all PWM Pins on the PCA9685 */
-        void digital_write_all(int value);
+        int digital_write_all(int value);
         
         /* PWM write value between 0-4095 to the given PWM Pin on the PCA9685 */
-        void pwm_write(Pin pin, int value);
+        int pwm_write(Pin pin, int value);
 
         /* PWM write value between 0-4095 to all PWM Pins on the PCA9685 */
-        void pwm_write_all(int value);
+        int pwm_write_all(int value);
+
+        /* PWM write 'count' values between 0-4095 to consecutive PWM Pins,
+         * starting at the given PWM Pin, in a single i2c burst.
+         * Out of range values are written as 0.
+        */
+        int pwm_write_burst(Pin pin, const uint16_t *values, int count);
+
+        /* Write already encoded LEDn_ON_L...LEDn_OFF_H registers for 'count'
+         * consecutive PWM Pins, starting at the given PWM Pin, in a single 
+         * i2c burst. See encode_channel().
+        */
+        int channel_write_burst(Pin pin, const uint8_t *regs, int count);
+
+        /* Encode the ON and OFF counter values between 0-4095 into the 
+         * UDRIVER_PCA9685_CHANNEL_BYTES channel registers at 'regs' */
+        static void encode_channel(int on, int off, uint8_t *regs);
     
         /* PWM pulse - pulse for the given microseconds for every PWM cycle */
-        virtual void pwm_pulse(Pin pin, int pulse_us);
+        int pwm_pulse(Pin pin, int pulse_us);
+
+        /* Record the given PWM Pin as pulsing for the given microseconds, so
+         * set_pwm_frequency() keeps the pulse, and return the PWM value to
+         * write for it, without any i2c traffic. Returns 
+         * MICROBIT_INVALID_PARAMETER, recording nothing, for a pulse outside
+         * 0 to the PWM period. */
+        virtual int prepare_pulse(Pin pin, int pulse_us);
 
         /* Change the PWM modulation frequency to the given frequency in hertz.
          * NOTE: This function assumes that no external clock is used, and the
          * internal osicalltor, with a clockfrequency of 25MHz, is used. 
         */
-        void set_pwm_frequency(int frequency);
+        int set_pwm_frequency(int frequency);
+
+        /* PWM modulation frequency in hertz last set on the PCA9685 */
+        int get_pwm_frequency();
 
         /* Activate low-power sleep mode on the PCA9685.
         */
-        void sleep();
+        int sleep();
         
         /* Deactivate low-power sleep mode on the PCA9685.
         */
-        void wake();
+        int wake();
+
+        /* Deactivate low-power sleep mode, restarting the PWM Pins that were
+         * running before sleep() with the RESTART bit so they do not need to
+         * be rewritten. Waits 500us for the oscillator to stabilize.
+        */
+        int restart();
+
+        /* Force the given PWM Pin fully off, 1, keeping its PWM value so that
+         * writing 0 resumes it with a single register write. */
+        int set_full_off(Pin pin, int value);
+
+        /* Whether the given PWM Pin is off, from the registers last written
+         * and without any i2c traffic */
+        bool is_channel_off(Pin pin);
+
+        /* Stop treating the PWM Pins whose bits are set in 'pins', bit 0 being
+         * Pin_P0, as pulsing, so set_pwm_frequency() leaves them alone */
+        void clear_pulse_mode(uint16_t pins);
+
+        /* Copy the given PWM Pin's registers last written into the
+         * UDRIVER_PCA9685_CHANNEL_BYTES at 'regs', without any i2c traffic */
+        void read_channel_cache(Pin pin, uint8_t *regs);
     
-        /* Make the PCA9685 do a software reset */
-        void software_reset();
+        /* Make every PCA9685 on the bus do a software reset, through the
+         * general call address */
+        int software_reset();
 
         /* Change the PCA9685's main address to a new i2c address*/
-        void change_address(I2CAddress addr);
+        int change_address(I2CAddress addr);
+
+        /* Attach the GPIO wired to the PCA9685's /OE pin, enabling the
+         * blanking and dimming fast path. Pass NULL to detach.
+        */
+        void attach_output_enable(OutputEnablePin *oe);
+
+        /* Turn off all outputs. With /OE attached this is a single pin edge
+         * with no i2c traffic and the channel registers are left intact,
+         * otherwise falls back to digital_write_all(0).
+        */
+        void blank();
+
+        /* Turn outputs back on after blank(), restoring the dim() level.
+         * NOTE: Only has an effect with /OE attached.
+        */
+        void unblank();
+
+        /* Dim all outputs globally to a level between 0-1023 using software
+         * PWM on /OE, where 1023 is full brightness.
+         * NOTE: Only has an effect with /OE attached.
+        */
+        void dim(int level);
+
+        /* Change how failed i2c transactions are handled */
+        void set_error_policy(const ErrorPolicy &policy);
+        const ErrorPolicy &get_error_policy();
+
+        /* Call the given handler, or NULL for none, whenever a transaction
+         * is given up on */
+        void set_error_handler(ErrorHandler handler);
+
+        const ErrorStats &get_error_stats();
+        void reset_error_stats();
+
+        /* Check the PCA9685's MODE1 register against its expected value. 
+         * A mismatch means the PCA9685 was reset, so every register is 
+         * restored. Returns 1 if restored, 0 if fine or an error status. */
+        int verify_mode();
+
+        /* Check the given PWM Pin's registers against their expected values,
+         * rewriting only those that differ. Returns the number of registers
+         * rewritten or an error status. */
+        int verify_channel(Pin pin);
+
+        /* Number of bytes save_state() needs */
+        virtual int state_size();
+
+        /* Serialize the driver's state, the PWM modulation frequency, the 
+         * PCA9685's registers and the pulses of the PWM Pins, into 'data'.
+         * Returns the number of bytes written. */
+        virtual int save_state(uint8_t *data);
+
+        /* Load the state serialized by save_state() and bring the PCA9685 
+         * back to it with one mode/prescale sequence and one burst. */
+        virtual int load_state(const uint8_t *data, int len);
         
     protected:
+        /* Last known contents of the writable registers */
+        typedef struct register_cache_t
+        {
+            uint8_t mode;
+            uint8_t prescale;
+            uint8_t channels[UDRIVER_PCA9685_PIN_COUNT * UDRIVER_PCA9685_CHANNEL_BYTES];
+        }RegisterCache;
+
         I2CAddress address;
+        I2CBus *bus;
+        PCA9685 *next_on_bus = NULL;
         uint8_t sub_addr = 0;
         uint8_t prev_mode = 0;
         uint16_t pwm_freq = 200;
         uint16_t pulse_mode = 0;
         uint16_t pulse_len[16];
+        OutputEnablePin *output_enable = NULL;
+        uint16_t oe_level = 1023;
+        bool blanked = false;
+        bool auto_inc = false;
+        bool recovering = false;
+        RegisterCache cache;
+        ErrorPolicy error_policy = ERROR_POLICY_DEFAULT;
+        ErrorHandler error_handler = NULL;
+        ErrorStats error_stats;
         
-        void register_write(uint8_t reg_addr, uint8_t value);
+        void apply_output_enable();
+        int i2c_transfer(I2CAddress address, const uint8_t *packet, int len, 
+                uint8_t *data, int data_len);
+        int transaction(const uint8_t *packet, int len, uint8_t *data, int data_len);
+        int transaction(I2CAddress address, const uint8_t *packet, int len, 
+                uint8_t *data, int data_len);
+        int register_write(uint8_t reg_addr, uint8_t value);
+        int register_write_burst(uint8_t reg_addr, const uint8_t *data, int len);
+        int register_read(uint8_t reg_addr, uint8_t *value);
         uint8_t register_read(uint8_t reg_addr);
-        void configure_mode(Mode setting, uint8_t value);
-        void restore_mode();
-        void add_alt_address(I2CAddress addr);
+        int register_read_burst(uint8_t reg_addr, uint8_t *data, int len);
+        void cache_reset();
+        void cache_write(uint8_t reg_addr, const uint8_t *data, int len);
+        int recover();
+        int restore_state();
+        int configure_mode(Mode setting, uint8_t value);
+        int restore_mode();
+        int add_alt_address(I2CAddress addr);
     };
 
+    class ServoCalibration;
+
     /* Represents a PCA9685 that can control servos */
     class PCA9685ServoController : public PCA9685
     {
     public:
-        PCA9685ServoController(I2CAddress addr=I2C_ADDRESS_ALL_CALL);
+        PCA9685ServoController(I2CAddress addr=I2C_ADDRESS_ALL_CALL, 
+                I2CBus &bus=I2CBus::primary());
     
         /* Move the servo's shaft to a certain angle in degrees */
-        void move_servo(Pin pin, double angle_deg);
+        int move_servo(Pin pin, double angle_deg);
+
+        /* Move 'count' servos on consecutive Pins starting from the given Pin
+         * to angles in tenths of a degree 0-1800, in one burst. */
+        int move_servos(Pin pin, const uint16_t *angles, int count);
         
         /* Configure the minimal pulse, maximum pulse  in microseconds 
          * for the servo for the given Pin. */
         void configure_servo(Pin pin, int min_us, int max_us);
 
-        /* Send PWM pulse to the servo */
-        virtual void pwm_pulse(Pin pin, int pulse_us);
+        /* Map angles for the servo on the given Pin through the calibration,
+         * which must outlive this controller and may be shared between Pins.
+         * The configured pulses become the calibration's shortest and 
+         * longest pulses. NULL maps linearly between them again. */
+        void calibrate_servo(Pin pin, const ServoCalibration *calibration);
+
+        /* Pulse in microseconds for the angle in tenths of a degree 0-1800 */
+        int servo_pulse(Pin pin, int angle);
+
+        /* As PCA9685, keeping pulses of servo Pins within their range */
+        virtual int prepare_pulse(Pin pin, int pulse_us);
+
+        /* Mark the given Pin as a servo Pin and prepare_pulse() for the angle
+         * in tenths of a degree 0-1800, without any i2c traffic */
+        int prepare_servo(Pin pin, int angle);
+
+        /* As PCA9685, adding the servo ranges. Calibrations are not saved. */
+        virtual int state_size();
+        virtual int save_state(uint8_t *data);
+        virtual int load_state(const uint8_t *data, int len);
         
     protected:
         uint16_t servo_mode;
         uint16_t pulse_min[16];
         uint16_t pulse_max[16];
+        const ServoCalibration *calibration[16];
     };
 }
 #endif /* ifndef UDRIVER_PCA9685 */
@@ -34,6 +34,21 @@ namespace UDriver_PCA9685
         P15
     }
 
+    /**
+     * Defines the curves mapping analog write values to perceived brightness
+    */
+    export enum BrightnessCurve
+    {
+        //%block="linear"
+        Linear = 0,
+        //%block="gamma 2.2"
+        Gamma22 = 1,
+        //%block="gamma 2.8"
+        Gamma28 = 2,
+        //%block="CIE 1931"
+        CIE1931 = 3
+    }
+
     let pwm_frequency:number = 200; //Frequency for input checking
 
     /** 
@@ -292,5 +307,126 @@ namespace UDriver_PCA9685
         //Dummy Implmentation for the Microbit simulator
         console.log("Simulate:uDriver PCA9685:configure_servo: pin:" + pin
             + " min:" + min_value + " max:" + max_value );
-    } 
+    }
+
+    /**
+     * Use the given MicroBit 'pin', wired to the PCA9685's /OE pin, to blank
+     * and dim all outputs instantly without any i2c traffic.
+    */
+    //%blockId=UDriver_PCA9685_attach_output_enable
+    //%block="attach PCA9685 output enable|to pin %pin"
+    //%advanced=true
+    //%shim=UDriver_PCA9685::attach_output_enable
+    export function attach_output_enable(pin:DigitalPin)
+    {
+        //Dummy Implmentation for the Microbit simulator
+        console.log("Simulate:uDriver PCA9685:attach_output_enable: " + pin);
+    }
+
+    /**
+     * Turn off every single pin on the PCA9685, keeping the values written
+     * to each pin so that unblank() can turn them back on.
+    */
+    //%blockId=UDriver_PCA9685_blank
+    //%block="PCA9685 blank all pins"
+    //%advanced=true
+    //%shim=UDriver_PCA9685::blank
+    export function blank()
+    {
+        //Dummy Implmentation for the Microbit simulator
+        console.log("Simulate:uDriver PCA9685:blank");
+    }
+
+    /**
+     * Turn every single pin on the PCA9685 back on after blank()
+    */
+    //%blockId=UDriver_PCA9685_unblank
+    //%block="PCA9685 unblank all pins"
+    //%advanced=true
+    //%shim=UDriver_PCA9685::unblank
+    export function unblank()
+    {
+        //Dummy Implmentation for the Microbit simulator
+        console.log("Simulate:uDriver PCA9685:unblank");
+    }
+
+    /**
+     * Dim every single pin on the PCA9685 to a 'level' between 0 and 1023,
+     * where 1023 is full brightness. Requires attach_output_enable().
+    */
+    //%blockId=UDriver_PCA9685_dim
+    //%block="PCA9685 dim all pins|to %level"
+    //%advanced=true
+    //%shim=UDriver_PCA9685::dim
+    export function dim(level:number)
+    {
+        if(level < 0 || level > 1023)
+        {
+            console.log("uDriver PCA9685: dim(): Invaild Argument " +
+                "- Dim level should be between 0 and 1023.");
+            return;
+        }
+        //Dummy Implmentation for the Microbit simulator
+        console.log("Simulate:uDriver PCA9685:dim: " + level);
+    }
+
+    /**
+     * Use the given brightness 'curve' for analog writes to the given 'pin',
+     * so that LED fades look even to the eye. Analog writes are linear
+     * by default.
+    */
+    //%blockId=UDriver_PCA9685_set_brightness_curve
+    //%block="set brightness curve|of pin %pin|to %curve"
+    //%advanced=true
+    //%shim=UDriver_PCA9685::set_brightness_curve
+    export function set_brightness_curve(pin:Pin, curve:BrightnessCurve)
+    {
+        //Dummy Implmentation for the Microbit simulator
+        console.log("Simulate:uDriver PCA9685:set_brightness_curve: pin:" + pin
+            + " curve:" + curve);
+    }
+
+    /**
+     * Choose whether the MicroBit panics when the PCA9685 cannot be reached,
+     * after retrying and resetting the i2c bus. When 'panic' is false, the
+     * failed write is skipped instead and the program keeps running.
+    */
+    //%blockId=UDriver_PCA9685_set_error_panic
+    //%block="PCA9685 panic on i2c errors|%panic"
+    //%advanced=true
+    //%shim=UDriver_PCA9685::set_error_panic
+    export function set_error_panic(panic:boolean)
+    {
+        //Dummy Implmentation for the Microbit simulator
+        console.log("Simulate:uDriver PCA9685:set_error_panic: " + panic);
+    }
+
+    /**
+     * Save the PCA9685's frequency, pin outputs and servo ranges to flash,
+     * so that they can be restored after the MicroBit resets.
+    */
+    //%blockId=UDriver_PCA9685_save_state
+    //%block="save PCA9685 state"
+    //%advanced=true
+    //%shim=UDriver_PCA9685::save_state
+    export function save_state()
+    {
+        //Dummy Implmentation for the Microbit simulator
+        console.log("Simulate:uDriver PCA9685:save_state");
+    }
+
+    /**
+     * Restore the state last saved with "save PCA9685 state". Returns false
+     * if no state was saved.
+    */
+    //%blockId=UDriver_PCA9685_restore_state
+    //%block="restore PCA9685 state"
+    //%advanced=true
+    //%shim=UDriver_PCA9685::restore_state
+    export function restore_state(): boolean
+    {
+        //Dummy Implmentation for the Microbit simulator
+        console.log("Simulate:uDriver PCA9685:restore_state");
+        return false;
+    }
 }
@@ -0,0 +1,234 @@
+/*
+ * udriver_pca9685_animator.cpp
+ * Keyframe animation engine for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_animator.h"
+
+#define EASE_ONE (1UL << 15) /* Fixed point 1.0 for easing */
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+Animator::Animator()
+{
+    for(int i = 0; i < UDRIVER_PCA9685_ANIMATOR_TRACKS; i ++)
+        this->tracks[i].used = false;
+}
+
+int Animator::add_track(PCA9685 &device, Pin pin, const Keyframe *frames, 
+        int count, bool loop, uint8_t trigger)
+{
+    if(count <= 0 || count > 0xFF) return MICROBIT_INVALID_PARAMETER;
+
+    for(int i = 0; i < UDRIVER_PCA9685_ANIMATOR_TRACKS; i ++)
+    {
+        Track &track = this->tracks[i];
+        if(track.used) continue;
+
+        track.device = &device;
+        track.frames = frames;
+        track.count = count;
+        track.pin = pin;
+        track.loop = loop && frames[count - 1].time_ms > 0;
+        track.trigger = trigger;
+        track.used = true;
+        return i;
+    }
+    return MICROBIT_NO_RESOURCES;
+}
+
+void Animator::remove_track(int track)
+{
+    if(track < 0 || track >= UDRIVER_PCA9685_ANIMATOR_TRACKS) return;
+
+    this->stop(track);
+    this->tracks[track].used = false;
+}
+
+void Animator::play(int track)
+{
+    if(track < 0 || track >= UDRIVER_PCA9685_ANIMATOR_TRACKS) return;
+    if(!this->tracks[track].used) return;
+
+    Track &t = this->tracks[track];
+    t.start_ms = this->started ? this->now_ms : 0;
+    t.cursor = 0;
+    t.fresh = true;
+
+    if(!this->is_playing(track)) this->playing[this->playing_count ++] = track;
+}
+
+void Animator::stop(int track)
+{
+    for(int i = 0; i < this->playing_count; i ++)
+    {
+        if(this->playing[i] != track) continue;
+
+        this->playing[i] = this->playing[-- this->playing_count];
+        return;
+    }
+}
+
+void Animator::trigger(uint8_t trigger)
+{
+    if(trigger == 0) return;
+
+    for(int i = 0; i < UDRIVER_PCA9685_ANIMATOR_TRACKS; i ++)
+        if(this->tracks[i].used && this->tracks[i].trigger == trigger) this->play(i);
+}
+
+bool Animator::is_playing(int track)
+{
+    for(int i = 0; i < this->playing_count; i ++)
+        if(this->playing[i] == track) return true;
+    return false;
+}
+
+uint16_t Animator::evaluate(Track &track, uint32_t now_ms, bool *done)
+{
+    const Keyframe *frames = track.frames;
+    uint32_t elapsed = now_ms - track.start_ms;
+    uint16_t length = frames[track.count - 1].time_ms;
+
+    *done = false;
+    if(elapsed >= length)
+    {
+        if(!track.loop)
+        {
+            *done = true;
+            return frames[track.count - 1].value;
+        }
+
+        //Restart the loop, keeping the phase
+        track.start_ms += elapsed - (elapsed % length);
+        elapsed %= length;
+        track.cursor = 0;
+    }
+
+    //Cursor only moves forward, so this is constant time per tick
+    while(track.cursor < track.count && frames[track.cursor].time_ms <= elapsed) 
+        track.cursor ++;
+    if(track.cursor == 0) return frames[0].value;
+
+    const Keyframe &from = frames[track.cursor - 1];
+    const Keyframe &to = frames[track.cursor];
+    if(to.ease == Ease_Step) return from.value;
+
+    uint32_t t = (elapsed - from.time_ms) * EASE_ONE / (to.time_ms - from.time_ms);
+    if(to.ease == Ease_InOut) 
+        t = ((t * t) >> 15) * (3 * EASE_ONE - 2 * t) >> 15;
+
+    return from.value + (((int32_t)to.value - from.value) * (int32_t)t) / (int32_t)EASE_ONE;
+}
+
+int Animator::tick()
+{
+    return this->tick(system_timer_current_time());
+}
+
+int Animator::tick(uint32_t now_ms)
+{
+    //Changed values grouped by device, written after every track is evaluated
+    PCA9685 *devices[UDRIVER_PCA9685_ANIMATOR_DEVICES];
+    uint16_t values[UDRIVER_PCA9685_ANIMATOR_DEVICES][UDRIVER_PCA9685_PIN_COUNT];
+    uint16_t dirty[UDRIVER_PCA9685_ANIMATOR_DEVICES];
+    uint16_t written[UDRIVER_PCA9685_ANIMATOR_DEVICES];
+    int device_count = 0;
+
+    //Per playing track: value to write, device it is grouped in, and done
+    uint16_t pending[UDRIVER_PCA9685_ANIMATOR_TRACKS];
+    int8_t group[UDRIVER_PCA9685_ANIMATOR_TRACKS];
+    bool done[UDRIVER_PCA9685_ANIMATOR_TRACKS];
+    
+    if(!this->started)
+    {
+        //Tracks played before the first tick start with it
+        for(int i = 0; i < this->playing_count; i ++)
+            this->tracks[this->playing[i]].start_ms = now_ms;
+        this->started = true;
+    }
+    this->now_ms = now_ms;
+
+    //Start from the track left out for lack of room last tick, so every
+    //device gets its turn
+    int start = 0;
+    for(int i = 0; i < this->playing_count; i ++)
+        if(this->playing[i] == this->resume) start = i;
+    this->resume = -1;
+    
+    for(int n = 0; n < this->playing_count; n ++)
+    {
+        int i = (start + n) % this->playing_count;
+        Track &track = this->tracks[this->playing[i]];
+        uint16_t value = this->evaluate(track, now_ms, &done[i]);
+
+        group[i] = -1;
+        if(value == track.value && !track.fresh) continue;
+
+        int device = 0;
+        while(device < device_count && devices[device] != track.device) device ++;
+        if(device == device_count)
+        {
+            //Out of room: written on the next tick, which starts here
+            if(device_count == UDRIVER_PCA9685_ANIMATOR_DEVICES) 
+            { 
+                if(this->resume < 0) this->resume = this->playing[i];
+                done[i] = false;
+                continue; 
+            }
+            devices[device_count] = track.device;
+            dirty[device_count] = 0;
+            written[device_count ++] = 0;
+        }
+
+        values[device][track.pin] = value;
+        dirty[device] |= (1 << track.pin);
+        pending[i] = value;
+        group[i] = device;
+    }
+
+    //Write each device's contiguous runs of changed PWM Pins as bursts
+    int count = 0;
+    int status = MICROBIT_OK;
+    for(int device = 0; device < device_count; device ++)
+    {
+        for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; )
+        {
+            if(!(dirty[device] & (1 << pin))) { pin ++; continue; }
+
+            int first = pin;
+            while(pin < UDRIVER_PCA9685_PIN_COUNT && (dirty[device] & (1 << pin))) pin ++;
+            int result = devices[device]->pwm_write_burst((Pin)first, 
+                    values[device] + first, pin - first);
+            if(result != MICROBIT_OK)
+            {
+                status = result;
+                continue;
+            }
+            written[device] |= ((1 << pin) - 1) & ~((1 << first) - 1);
+            count += pin - first;
+        }
+    }
+
+    //Only written values are committed, the rest are retried next tick, and
+    //finished tracks stop once their last value is written
+    int kept = 0;
+    for(int i = 0; i < this->playing_count; i ++)
+    {
+        Track &track = this->tracks[this->playing[i]];
+        if(group[i] >= 0)
+        {
+            if(written[group[i]] & (1 << track.pin))
+            {
+                track.value = pending[i];
+                track.fresh = false;
+            }
+            else done[i] = false;
+        }
+        if(!done[i]) this->playing[kept ++] = this->playing[i];
+    }
+    this->playing_count = kept;
+
+    return (status == MICROBIT_OK) ? count : status;
+}
@@ -0,0 +1,96 @@
+#ifndef UDRIVER_PCA9685_ANIMATOR
+#define UDRIVER_PCA9685_ANIMATOR
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_ANIMATOR_TRACKS 32
+#define UDRIVER_PCA9685_ANIMATOR_DEVICES 4 /* Devices written per tick */
+namespace UDriver_PCA9685 
+{
+    /* Defines how a track eases into a keyframe from the one before */
+    typedef enum ease_t
+    {
+        Ease_Step = 0, /* Jump at the keyframe's time */
+        Ease_Linear = 1,
+        Ease_InOut = 2 /* Smoothstep: slow start and slow finish */
+    }Ease;
+
+    /* A PWM value between 0-4095 reached at a time in milliseconds from
+     * the start of the track */
+    typedef struct keyframe_t
+    {
+        uint16_t time_ms;
+        uint16_t value;
+        uint8_t ease;
+    }Keyframe;
+
+    /* Plays keyframe tracks on PWM Pins of one or more PCA9685s. Each tick
+     * only evaluates the tracks that are playing, and the changed PWM Pins
+     * of each device are written as bursts. When more devices have changes
+     * than UDRIVER_PCA9685_ANIMATOR_DEVICES, the rest are written on the
+     * next tick, which starts with them.
+    */
+    class Animator
+    {
+    public:
+        Animator();
+
+        /* Add a track playing 'count' keyframes, sorted by time, on the
+         * given PWM Pin. The keyframes are not copied and must outlive the
+         * track. A track with a 'trigger' other than 0 is also started by 
+         * trigger(). Returns the track's id, or MICROBIT_NO_RESOURCES.
+        */
+        int add_track(PCA9685 &device, Pin pin, const Keyframe *frames, 
+                int count, bool loop=false, uint8_t trigger=0);
+        
+        /* Remove the track, stopping it if it is playing */
+        void remove_track(int track);
+
+        /* Start playing the track from its first keyframe */
+        void play(int track);
+
+        /* Stop the track, leaving the PWM Pin at its last value */
+        void stop(int track);
+
+        /* Start every track with the given trigger */
+        void trigger(uint8_t trigger);
+
+        bool is_playing(int track);
+
+        /* Evaluate the tracks that are playing at the current system time.
+         * Returns the number of PWM Pins written, or an error status if a
+         * burst failed. PWM Pins not written are retried on the next tick. */
+        int tick();
+
+        /* Evaluate the tracks that are playing at the given system time in
+         * milliseconds. Returns the number of PWM Pins written, or an error
+         * status if a burst failed. */
+        int tick(uint32_t now_ms);
+
+    protected:
+        typedef struct track_t
+        {
+            PCA9685 *device;
+            const Keyframe *frames;
+            uint32_t start_ms;
+            uint16_t value; /* Last value written */
+            uint8_t count;
+            uint8_t cursor; /* Keyframe the track is easing into */
+            uint8_t pin;
+            uint8_t trigger;
+            bool loop;
+            bool used;
+            bool fresh; /* Nothing written since started */
+        }Track;
+
+        Track tracks[UDRIVER_PCA9685_ANIMATOR_TRACKS];
+        uint8_t playing[UDRIVER_PCA9685_ANIMATOR_TRACKS]; /* Track ids */
+        int playing_count = 0;
+        int resume = -1; /* Track left out for lack of room, scanned first */
+        bool started = false;
+        uint32_t now_ms = 0;
+
+        uint16_t evaluate(Track &track, uint32_t now_ms, bool *done);
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_ANIMATOR */
@@ -0,0 +1,209 @@
+/*
+ * udriver_pca9685_async.cpp
+ * Asynchronous operations and event loop for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_async.h"
+#include "udriver_pca9685_trace.h"
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+#define ENTRY_FREE 0
+#define ENTRY_QUEUED 1
+#define ENTRY_IN_FLIGHT 2
+
+int DeviceTransport::start(PCA9685 &device, Pin pin, const uint8_t *regs, int count)
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("transport_start");
+    this->status = device.channel_write_burst(pin, regs, count);
+    return MICROBIT_OK;
+}
+
+int DeviceTransport::poll()
+{
+    return this->status;
+}
+
+SimulatedTransport::SimulatedTransport(uint32_t latency_us) : latency_us(latency_us)
+{
+    memset(this->channels, 0, sizeof(this->channels));
+}
+
+int SimulatedTransport::start(PCA9685 &device, Pin pin, const uint8_t *regs, int count)
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("transport_start");
+    memcpy(this->channels + pin * UDRIVER_PCA9685_CHANNEL_BYTES, regs, 
+        count * UDRIVER_PCA9685_CHANNEL_BYTES);
+    this->done_us = system_timer_current_time_us() + this->latency_us;
+    this->transfers ++;
+    return MICROBIT_OK;
+}
+
+int SimulatedTransport::poll()
+{
+    return (system_timer_current_time_us() < this->done_us) ? MICROBIT_BUSY : MICROBIT_OK;
+}
+
+AsyncLoop::AsyncLoop()
+{
+    for(int i = 0; i < UDRIVER_PCA9685_ASYNC_OPS; i ++)
+        this->entries[i].state = ENTRY_FREE;
+}
+
+void AsyncLoop::submit(AsyncTransport &transport, PCA9685 &device, Pin pin, 
+        const uint8_t *regs, int count, AsyncOp &op)
+{
+    op.status = MICROBIT_BUSY;
+    op.done = false;
+    if(count <= 0 || pin + count > UDRIVER_PCA9685_PIN_COUNT)
+    {
+        op.status = MICROBIT_INVALID_PARAMETER;
+        op.done = true;
+        if(op.callback != NULL) op.callback(op);
+        return;
+    }
+
+    AsyncEntry *entry = NULL;
+    while(entry == NULL)
+    {
+        for(int i = 0; i < UDRIVER_PCA9685_ASYNC_OPS && entry == NULL; i ++)
+        {
+            if(this->entries[i].state == ENTRY_FREE) entry = &this->entries[i];
+        }
+        if(entry == NULL && this->run_once() > 0) schedule();
+    }
+
+    entry->transport = &transport;
+    entry->device = &device;
+    entry->op = &op;
+    entry->order = this->next_order ++;
+    memcpy(entry->regs, regs, count * UDRIVER_PCA9685_CHANNEL_BYTES);
+    entry->pin = pin;
+    entry->count = count;
+    entry->state = ENTRY_QUEUED;
+    this->run_once(); //Start it straight away if its transport is idle
+}
+
+void AsyncLoop::complete(AsyncEntry &entry, int status)
+{
+    entry.state = ENTRY_FREE;
+    entry.op->status = status;
+    entry.op->done = true;
+    if(entry.op->callback != NULL) entry.op->callback(*entry.op);
+}
+
+int AsyncLoop::run_once()
+{
+    UDRIVER_PCA9685_TRACE_SCOPE("async_run_once");
+    //Finish transfers
+    for(int i = 0; i < UDRIVER_PCA9685_ASYNC_OPS; i ++)
+    {
+        AsyncEntry &entry = this->entries[i];
+        if(entry.state != ENTRY_IN_FLIGHT) continue;
+
+        int status = entry.transport->poll();
+        if(status != MICROBIT_BUSY) this->complete(entry, status);
+    }
+
+    //Start the oldest queued operation of every idle transport
+    int outstanding = 0;
+    for(int i = 0; i < UDRIVER_PCA9685_ASYNC_OPS; i ++)
+    {
+        AsyncEntry &entry = this->entries[i];
+        if(entry.state == ENTRY_FREE) continue;
+        outstanding ++;
+        if(entry.state != ENTRY_QUEUED) continue;
+
+        bool first = true;
+        for(int j = 0; j < UDRIVER_PCA9685_ASYNC_OPS && first; j ++)
+        {
+            AsyncEntry &other = this->entries[j];
+            if(other.state == ENTRY_FREE || other.transport != entry.transport) continue;
+            if(other.state == ENTRY_IN_FLIGHT) first = false;
+            if(other.state == ENTRY_QUEUED && (int32_t)(other.order - entry.order) < 0) 
+                first = false;
+        }
+        if(!first) continue;
+
+        entry.state = ENTRY_IN_FLIGHT;
+        int status = entry.transport->start(*entry.device, (Pin)entry.pin, 
+            entry.regs, entry.count);
+        if(status != MICROBIT_OK) 
+        {
+            this->complete(entry, status);
+            outstanding --;
+        }
+    }
+    return outstanding;
+}
+
+int AsyncLoop::wait(AsyncOp &op)
+{
+    while(!op.done)
+    {
+        this->run_once();
+        if(!op.done) schedule();
+    }
+    return op.status;
+}
+
+void AsyncLoop::wait_all()
+{
+    while(this->run_once() > 0) schedule();
+}
+
+AsyncDevice::AsyncDevice(PCA9685 &device, AsyncTransport &transport, AsyncLoop &loop)
+    : device(device), transport(transport), loop(loop)
+{
+}
+
+void AsyncDevice::digital_write(Pin pin, int value, AsyncOp &op)
+{
+    uint8_t regs[UDRIVER_PCA9685_CHANNEL_BYTES];
+    //FULL ON or FULL OFF, like PCA9685::digital_write()
+    PCA9685::encode_channel((value == 1) ? 0x1000 : 0, (value == 1) ? 0 : 0x1000, regs);
+    this->loop.submit(this->transport, this->device, pin, regs, 
+        (value < 0 || value > 1) ? 0 : 1, op);
+}
+
+void AsyncDevice::pwm_write(Pin pin, int value, AsyncOp &op)
+{
+    uint16_t values[1] = { (uint16_t)value };
+    if(value < UDRIVER_PCA9685_PWM_MIN || value > UDRIVER_PCA9685_PWM_MAX)
+    {
+        this->loop.submit(this->transport, this->device, pin, NULL, 0, op);
+        return;
+    }
+    this->pwm_write_burst(pin, values, 1, op);
+}
+
+void AsyncDevice::pwm_write_burst(Pin pin, const uint16_t *values, int count, AsyncOp &op)
+{
+    uint8_t regs[UDRIVER_PCA9685_PIN_COUNT * UDRIVER_PCA9685_CHANNEL_BYTES];
+    count = (count > UDRIVER_PCA9685_PIN_COUNT) ? 0 : count;
+    for(int i = 0; i < count; i ++)
+    {
+        int value = (values[i] > UDRIVER_PCA9685_PWM_MAX) ? 0 : values[i];
+        PCA9685::encode_channel(0, value, regs + i * UDRIVER_PCA9685_CHANNEL_BYTES);
+    }
+    this->loop.submit(this->transport, this->device, pin, regs, count, op);
+}
+
+void AsyncDevice::pwm_pulse(Pin pin, int pulse_us, AsyncOp &op)
+{
+    //Recorded like PCA9685::pwm_pulse(), so set_pwm_frequency() keeps it.
+    //pwm_write() reports an error or out of range result as invalid
+    this->pwm_write(pin, this->device.prepare_pulse(pin, pulse_us), op);
+}
+
+AsyncServoController::AsyncServoController(PCA9685ServoController &device, 
+        AsyncTransport &transport, AsyncLoop &loop)
+    : AsyncDevice(device, transport, loop), servo_device(device)
+{
+}
+
+void AsyncServoController::move_servo(Pin pin, int angle, AsyncOp &op)
+{
+    this->pwm_write(pin, this->servo_device.prepare_servo(pin, angle), op);
+}
@@ -0,0 +1,145 @@
+#ifndef UDRIVER_PCA9685_ASYNC
+#define UDRIVER_PCA9685_ASYNC
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_ASYNC_OPS 8 /* Operations queued or in flight */
+namespace UDriver_PCA9685 
+{
+    typedef struct async_op_t AsyncOp;
+    typedef void (*AsyncCallback)(AsyncOp &op);
+
+    /* Handle of an asynchronous operation, which must stay valid until done.
+     * Set the callback and context, or zero them, before starting it. */
+    typedef struct async_op_t
+    {
+        volatile int status; /* MICROBIT_BUSY until done */
+        volatile bool done;
+        AsyncCallback callback; /* Called once done, or NULL */
+        void *context; /* For the callback */
+    }AsyncOp;
+
+    /* Writes channel registers without waiting for the transfer to finish.
+     * A transport carries one transfer at a time, so transfers on different
+     * transports overlap.
+    */
+    class AsyncTransport
+    {
+    public:
+        /* Start writing the encoded registers of 'count' consecutive PWM Pins
+         * of the device, starting at the given PWM Pin */
+        virtual int start(PCA9685 &device, Pin pin, const uint8_t *regs, int count) = 0;
+
+        /* Status of the transfer started last, MICROBIT_BUSY until done */
+        virtual int poll() = 0;
+    };
+
+    /* AsyncTransport writing through the device itself. i2c writes block on
+     * the MicroBit, so transfers are done by the time start() returns. */
+    class DeviceTransport : public AsyncTransport
+    {
+    public:
+        virtual int start(PCA9685 &device, Pin pin, const uint8_t *regs, int count);
+        virtual int poll();
+
+    protected:
+        int status = MICROBIT_OK;
+    };
+
+    /* AsyncTransport that only records transfers, taking the given latency
+     * in microseconds to finish each, for tests and benchmarks off target */
+    class SimulatedTransport : public AsyncTransport
+    {
+    public:
+        SimulatedTransport(uint32_t latency_us);
+
+        virtual int start(PCA9685 &device, Pin pin, const uint8_t *regs, int count);
+        virtual int poll();
+
+        /* Channel registers as last written, indexed like the PCA9685's */
+        uint8_t channels[UDRIVER_PCA9685_PIN_COUNT * UDRIVER_PCA9685_CHANNEL_BYTES];
+        uint32_t transfers = 0;
+
+    protected:
+        uint32_t latency_us;
+        uint64_t done_us = 0;
+    };
+
+    /* Single threaded event loop running asynchronous operations over
+     * their transports. Operations on one transport run in the order they
+     * were started, while different transports run at the same time.
+    */
+    class AsyncLoop
+    {
+    public:
+        AsyncLoop();
+
+        /* Queue writing encoded registers, as AsyncTransport::start(). Waits
+         * for room if UDRIVER_PCA9685_ASYNC_OPS operations are outstanding. */
+        void submit(AsyncTransport &transport, PCA9685 &device, Pin pin, 
+                const uint8_t *regs, int count, AsyncOp &op);
+
+        /* Complete finished transfers and start queued ones. 
+         * Returns the number of operations outstanding. */
+        int run_once();
+
+        /* Run the loop until the operation is done, yielding to other fibers
+         * in between. Returns the operation's status. */
+        int wait(AsyncOp &op);
+
+        /* Run the loop until every operation is done */
+        void wait_all();
+
+    protected:
+        typedef struct async_entry_t
+        {
+            AsyncTransport *transport;
+            PCA9685 *device;
+            AsyncOp *op;
+            uint32_t order; /* Submission order */
+            uint8_t regs[UDRIVER_PCA9685_PIN_COUNT * UDRIVER_PCA9685_CHANNEL_BYTES];
+            uint8_t pin;
+            uint8_t count;
+            uint8_t state;
+        }AsyncEntry;
+
+        AsyncEntry entries[UDRIVER_PCA9685_ASYNC_OPS];
+        uint32_t next_order = 0;
+
+        void complete(AsyncEntry &entry, int status);
+    };
+
+    /* Asynchronous versions of the PCA9685's PWM operations. Each returns
+     * straight away; wait on the loop or pass a callback in the AsyncOp.
+    */
+    class AsyncDevice
+    {
+    public:
+        AsyncDevice(PCA9685 &device, AsyncTransport &transport, AsyncLoop &loop);
+
+        void digital_write(Pin pin, int value, AsyncOp &op);
+        void pwm_write(Pin pin, int value, AsyncOp &op);
+        void pwm_write_burst(Pin pin, const uint16_t *values, int count, AsyncOp &op);
+        void pwm_pulse(Pin pin, int pulse_us, AsyncOp &op);
+
+    protected:
+        PCA9685 &device;
+        AsyncTransport &transport;
+        AsyncLoop &loop;
+    };
+
+    /* Asynchronous versions of the PCA9685ServoController's operations */
+    class AsyncServoController : public AsyncDevice
+    {
+    public:
+        AsyncServoController(PCA9685ServoController &device, 
+                AsyncTransport &transport, AsyncLoop &loop);
+
+        /* Move the servo's shaft to the angle in tenths of a degree 0-1800 */
+        void move_servo(Pin pin, int angle, AsyncOp &op);
+
+    protected:
+        PCA9685ServoController &servo_device;
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_ASYNC */
@@ -0,0 +1,71 @@
+/*
+ * udriver_pca9685_calibration.cpp
+ * Servo angle calibration tables for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_calibration.h"
+#include "udriver_pca9685_kernels.h"
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+ServoCalibration::ServoCalibration(const uint16_t *pulses_us, int count)
+{
+    this->set_points(pulses_us, count);
+}
+
+ServoCalibration::ServoCalibration(int min_us, int max_us)
+{
+    uint16_t pulses_us[2] = { (uint16_t)min_us, (uint16_t)max_us };
+    this->set_points(pulses_us, 2);
+}
+
+void ServoCalibration::set_points(const uint16_t *pulses_us, int count)
+{
+    count = (count < 2) ? 2 : count;
+    count = (count > UDRIVER_PCA9685_CALIBRATION_POINTS) 
+        ? UDRIVER_PCA9685_CALIBRATION_POINTS : count;
+    
+    memcpy(this->points, pulses_us, count * sizeof(uint16_t));
+    this->count = count;
+    //Rounded up so that angles on a breakpoint land exactly on it
+    this->scale = (((uint32_t)(count - 1) << 24) + UDRIVER_PCA9685_ANGLE_MAX - 1) 
+        / UDRIVER_PCA9685_ANGLE_MAX;
+}
+
+uint16_t ServoCalibration::pulse(int angle) const
+{
+    angle = (angle < 0) ? 0 : angle;
+    angle = (angle > UDRIVER_PCA9685_ANGLE_MAX) ? UDRIVER_PCA9685_ANGLE_MAX : angle;
+
+    //Segment and position within it, without a division
+    uint32_t position = angle * this->scale;
+    uint32_t index = position >> 24;
+    if(index >= (uint32_t)this->count - 1) return this->points[this->count - 1];
+
+    int32_t frac = (position & 0xFFFFFF) >> 9; //15 bit fraction
+    int32_t low = this->points[index];
+    int32_t high = this->points[index + 1];
+    return low + (((high - low) * frac + (1 << 14)) >> 15);
+}
+
+uint16_t ServoCalibration::min_pulse() const
+{
+    uint16_t pulse_us = this->points[0];
+    for(int i = 1; i < this->count; i ++)
+        pulse_us = (this->points[i] < pulse_us) ? this->points[i] : pulse_us;
+    return pulse_us;
+}
+
+uint16_t ServoCalibration::max_pulse() const
+{
+    uint16_t pulse_us = this->points[0];
+    for(int i = 1; i < this->count; i ++)
+        pulse_us = (this->points[i] > pulse_us) ? this->points[i] : pulse_us;
+    return pulse_us;
+}
+
+void ServoCalibration::pulses(const uint16_t *angles, uint16_t *pulses_us, int count) const
+{
+    for(int i = 0; i < count; i ++) pulses_us[i] = this->pulse(angles[i]);
+}
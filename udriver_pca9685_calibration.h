@@ -0,0 +1,43 @@
+#ifndef UDRIVER_PCA9685_CALIBRATION
+#define UDRIVER_PCA9685_CALIBRATION
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_CALIBRATION_POINTS 19 /* Up to one every 10 degrees */
+namespace UDriver_PCA9685 
+{
+    /* Calibrated angle to pulse mapping of a servo, as pulses measured at
+     * evenly spaced angles from 0 to 180 degrees, interpolated in fixed point.
+     * Share one ServoCalibration between all PWM Pins driving the same kind
+     * of servo.
+    */
+    class ServoCalibration
+    {
+    public:
+        /* Calibrate from 'count' pulses in microseconds, between 2 and 
+         * UDRIVER_PCA9685_CALIBRATION_POINTS, measured at angles evenly spaced
+         * from 0 to 180 degrees */
+        ServoCalibration(const uint16_t *pulses_us, int count);
+
+        /* Calibrate a linear servo from its pulses at 0 and 180 degrees */
+        ServoCalibration(int min_us, int max_us);
+
+        /* Pulse in microseconds for the angle in tenths of a degree 0-1800 */
+        uint16_t pulse(int angle) const;
+
+        /* Shortest and longest pulse in microseconds of the calibration */
+        uint16_t min_pulse() const;
+        uint16_t max_pulse() const;
+
+        /* Convert 'count' angles in tenths of a degree into pulses */
+        void pulses(const uint16_t *angles, uint16_t *pulses_us, int count) const;
+
+    protected:
+        uint16_t points[UDRIVER_PCA9685_CALIBRATION_POINTS];
+        uint32_t scale; /* Segments per tenth of a degree, 8.24 fixed point */
+        uint8_t count;
+
+        void set_points(const uint16_t *pulses_us, int count);
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_CALIBRATION */
@@ -0,0 +1,125 @@
+/*
+ * udriver_pca9685_channelmap.cpp
+ * Logical channel table over several PCA9685s for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_channelmap.h"
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+ChannelMap::ChannelMap(PCA9685 **devices, int count) : devices(devices)
+{
+    count = (count < 0) ? 0 : count;
+    this->device_count = (count > UDRIVER_PCA9685_CHANNELMAP_DEVICES) 
+        ? UDRIVER_PCA9685_CHANNELMAP_DEVICES : count;
+    memset(this->owned, 0, sizeof(this->owned));
+    memset(this->known, 0, sizeof(this->known));
+    this->reset_stats();
+}
+
+int ChannelMap::load(const ChannelMapping *mappings, int count)
+{
+    uint16_t owned[UDRIVER_PCA9685_CHANNELMAP_DEVICES] = { 0 };
+    this->mappings = NULL;
+    this->mapping_count = 0;
+    memset(this->owned, 0, sizeof(this->owned));
+    if(count < 0 || count > UDRIVER_PCA9685_CHANNELMAP_MAX) 
+        return MICROBIT_INVALID_PARAMETER;
+
+    for(int i = 0; i < count; i ++)
+    {
+        const ChannelMapping &mapping = mappings[i];
+        if(mapping.device >= this->device_count || 
+            mapping.pin >= UDRIVER_PCA9685_PIN_COUNT ||
+            (owned[mapping.device] & (1 << mapping.pin)))
+            return MICROBIT_INVALID_PARAMETER;
+        owned[mapping.device] |= (1 << mapping.pin);
+    }
+
+    //Values written for PWM Pins that stay in the table remain valid
+    for(int device = 0; device < this->device_count; device ++)
+        this->known[device] &= owned[device];
+    memcpy(this->owned, owned, sizeof(owned));
+    this->mappings = mappings;
+    this->mapping_count = count;
+    return MICROBIT_OK;
+}
+
+int ChannelMap::find(const char *name)
+{
+    for(int i = 0; i < this->mapping_count; i ++)
+    {
+        if(strcmp(this->mappings[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+int ChannelMap::update(const uint16_t *channels, const uint16_t *values, int count)
+{
+    uint64_t start_us = system_timer_current_time_us();
+    
+    //Bucket by device and PWM Pin, which sorts them in one pass
+    uint16_t dirty[UDRIVER_PCA9685_CHANNELMAP_DEVICES] = { 0 };
+    for(int i = 0; i < count; i ++)
+    {
+        if(channels[i] >= this->mapping_count || values[i] > UDRIVER_PCA9685_PWM_MAX)
+        {
+            this->stats.invalid ++;
+            continue;
+        }
+        
+        const ChannelMapping &mapping = this->mappings[channels[i]];
+        this->frame[mapping.device][mapping.pin] = values[i];
+        dirty[mapping.device] |= (1 << mapping.pin);
+        this->stats.updates ++;
+    }
+
+    int bursts = 0;
+    int status = MICROBIT_OK;
+    uint64_t grouped_us = system_timer_current_time_us();
+    this->stats.group_us += grouped_us - start_us;
+    for(int device = 0; device < this->device_count && status == MICROBIT_OK; device ++)
+    {
+        //Fill gaps whose PWM Pins are all owned and written
+        uint16_t fill = dirty[device] | (this->known[device] & this->owned[device]);
+        int pin = 0;
+        while(dirty[device] >> pin)
+        {
+            if(!(dirty[device] & (1 << pin)))
+            {
+                pin ++;
+                continue;
+            }
+
+            int start = pin;
+            int end = pin;
+            while(pin < UDRIVER_PCA9685_PIN_COUNT && (fill & (1 << pin)))
+            {
+                if(dirty[device] & (1 << pin)) end = pin;
+                pin ++;
+            }
+            
+            status = this->devices[device]->pwm_write_burst((Pin)start, 
+                this->frame[device] + start, end - start + 1);
+            if(status != MICROBIT_OK) break;
+            bursts ++;
+            pin = end + 1;
+        }
+        if(status == MICROBIT_OK) this->known[device] |= dirty[device];
+    }
+
+    this->stats.bus_us += system_timer_current_time_us() - grouped_us;
+    this->stats.bursts += bursts;
+    return (status == MICROBIT_OK) ? bursts : status;
+}
+
+const ChannelMapStats &ChannelMap::get_stats()
+{
+    return this->stats;
+}
+
+void ChannelMap::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(ChannelMapStats));
+}
@@ -0,0 +1,69 @@
+#ifndef UDRIVER_PCA9685_CHANNELMAP
+#define UDRIVER_PCA9685_CHANNELMAP
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_CHANNELMAP_DEVICES 8
+#define UDRIVER_PCA9685_CHANNELMAP_MAX (UDRIVER_PCA9685_CHANNELMAP_DEVICES \
+    * UDRIVER_PCA9685_PIN_COUNT)
+namespace UDriver_PCA9685 
+{
+    /* Maps a named logical channel to a PWM Pin on one of the devices */
+    typedef struct channel_mapping_t
+    {
+        const char *name; /* Must outlive the ChannelMap */
+        uint8_t device; /* Index of the device */
+        uint8_t pin;
+    }ChannelMapping;
+
+    /* Counters reported by the ChannelMap */
+    typedef struct channel_map_stats_t
+    {
+        uint32_t updates; /* Logical channels updated */
+        uint32_t invalid; /* Updates to unknown logical channels */
+        uint32_t bursts; /* i2c bursts sent */
+        uint32_t group_us; /* Time spent sorting and grouping */
+        uint32_t bus_us; /* Time spent writing */
+    }ChannelMapStats;
+
+    /* Table of logical channels over several PCA9685s. Logical channels are
+     * numbered by their position in the table; look numbers up by name once
+     * with find(). Bulk updates are grouped by device and PWM Pin, and each
+     * device gets one burst per run of PWM Pins. Gaps between runs are filled
+     * in from the last values written when every PWM Pin in the gap belongs
+     * to the table and has been written, so that a device usually gets a
+     * single burst.
+    */
+    class ChannelMap
+    {
+    public:
+        /* Map channels onto the 'count' devices, indexed by their position */
+        ChannelMap(PCA9685 **devices, int count);
+
+        /* Replace the table with 'count' mappings. Returns 
+         * MICROBIT_INVALID_PARAMETER if a mapping is out of range or two map 
+         * to the same PWM Pin, leaving the table empty. */
+        int load(const ChannelMapping *mappings, int count);
+
+        /* Number of the logical channel with the given name, or -1 */
+        int find(const char *name);
+
+        /* Set 'count' logical channels to PWM values between 0-4095 and write
+         * them. Returns the number of bursts sent, or an error status. */
+        int update(const uint16_t *channels, const uint16_t *values, int count);
+
+        const ChannelMapStats &get_stats();
+        void reset_stats();
+
+    protected:
+        PCA9685 **devices;
+        uint8_t device_count;
+        const ChannelMapping *mappings = NULL;
+        int mapping_count = 0;
+        uint16_t owned[UDRIVER_PCA9685_CHANNELMAP_DEVICES]; /* PWM Pins in the table */
+        uint16_t known[UDRIVER_PCA9685_CHANNELMAP_DEVICES]; /* PWM Pins written */
+        uint16_t frame[UDRIVER_PCA9685_CHANNELMAP_DEVICES][UDRIVER_PCA9685_PIN_COUNT];
+        ChannelMapStats stats;
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_CHANNELMAP */
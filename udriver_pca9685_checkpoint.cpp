@@ -0,0 +1,116 @@
+/*
+ * udriver_pca9685_checkpoint.cpp
+ * State checkpoints in flash storage for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_checkpoint.h"
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+#define CHECKPOINT_MAGIC 0x96
+#define CHECKPOINT_HEADER_BYTES 4 /* Magic, length, Fletcher-16 checksum */
+#define CHECKPOINT_BYTES (UDRIVER_PCA9685_CHECKPOINT_CHUNK * UDRIVER_PCA9685_CHECKPOINT_CHUNKS)
+
+static uint16_t checksum(const uint8_t *data, int len)
+{
+    uint16_t sum1 = 0, sum2 = 0;
+    for(int i = 0; i < len; i ++)
+    {
+        sum1 = (sum1 + data[i]) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    return (sum2 << 8) | sum1;
+}
+
+static int chunk_count(int len)
+{
+    return (len + UDRIVER_PCA9685_CHECKPOINT_CHUNK - 1) / UDRIVER_PCA9685_CHECKPOINT_CHUNK;
+}
+
+static void chunk_key(const char *name, int chunk, char *key)
+{
+    int len = strlen(name);
+    memcpy(key, name, len);
+    key[len] = '0' + chunk;
+    key[len + 1] = '\0';
+}
+
+int Checkpoint::save(PCA9685 &device, const char *name)
+{
+    uint8_t data[CHECKPOINT_BYTES];
+    char key[UDRIVER_PCA9685_CHECKPOINT_NAME_MAX + 2];
+    if(strlen(name) > UDRIVER_PCA9685_CHECKPOINT_NAME_MAX || 
+        device.state_size() + CHECKPOINT_HEADER_BYTES > CHECKPOINT_BYTES)
+        return MICROBIT_INVALID_PARAMETER;
+
+    int len = device.save_state(data + CHECKPOINT_HEADER_BYTES);
+    uint16_t sum = checksum(data + CHECKPOINT_HEADER_BYTES, len);
+    data[0] = CHECKPOINT_MAGIC;
+    data[1] = len;
+    data[2] = sum & 0xFF;
+    data[3] = sum >> 8;
+    len += CHECKPOINT_HEADER_BYTES;
+
+    for(int chunk = 0; chunk < chunk_count(len); chunk ++)
+    {
+        uint8_t *value = data + chunk * UDRIVER_PCA9685_CHECKPOINT_CHUNK;
+        int value_len = len - chunk * UDRIVER_PCA9685_CHECKPOINT_CHUNK;
+        value_len = (value_len > UDRIVER_PCA9685_CHECKPOINT_CHUNK) 
+            ? UDRIVER_PCA9685_CHECKPOINT_CHUNK : value_len;
+        chunk_key(name, chunk, key);
+
+        KeyValuePair *stored = uBit.storage.get(key);
+        bool same = stored != NULL && memcmp(stored->value, value, value_len) == 0;
+        delete stored;
+        if(same) continue;
+        
+        int status = uBit.storage.put(key, value, value_len);
+        if(status != MICROBIT_OK) return status;
+    }
+    return MICROBIT_OK;
+}
+
+int Checkpoint::restore(PCA9685 &device, const char *name)
+{
+    uint8_t data[CHECKPOINT_BYTES];
+    char key[UDRIVER_PCA9685_CHECKPOINT_NAME_MAX + 2];
+    if(strlen(name) > UDRIVER_PCA9685_CHECKPOINT_NAME_MAX) return MICROBIT_INVALID_PARAMETER;
+
+    //The length is only known once the first chunk is read
+    int len = UDRIVER_PCA9685_CHECKPOINT_CHUNK;
+    for(int chunk = 0; chunk < chunk_count(len); chunk ++)
+    {
+        chunk_key(name, chunk, key);
+        KeyValuePair *stored = uBit.storage.get(key);
+        if(stored == NULL) return MICROBIT_NO_DATA;
+        memcpy(data + chunk * UDRIVER_PCA9685_CHECKPOINT_CHUNK, stored->value, 
+            UDRIVER_PCA9685_CHECKPOINT_CHUNK);
+        delete stored;
+
+        if(chunk > 0) continue;
+        if(data[0] != CHECKPOINT_MAGIC) return MICROBIT_NO_DATA;
+        len = data[1] + CHECKPOINT_HEADER_BYTES;
+        if(len > CHECKPOINT_BYTES) return MICROBIT_NO_DATA;
+    }
+
+    uint16_t sum = data[2] | (data[3] << 8);
+    if(data[1] != device.state_size() || 
+        checksum(data + CHECKPOINT_HEADER_BYTES, data[1]) != sum)
+        return MICROBIT_NO_DATA;
+    
+    return device.load_state(data + CHECKPOINT_HEADER_BYTES, data[1]);
+}
+
+int Checkpoint::remove(const char *name)
+{
+    char key[UDRIVER_PCA9685_CHECKPOINT_NAME_MAX + 2];
+    if(strlen(name) > UDRIVER_PCA9685_CHECKPOINT_NAME_MAX) return MICROBIT_INVALID_PARAMETER;
+
+    for(int chunk = 0; chunk < UDRIVER_PCA9685_CHECKPOINT_CHUNKS; chunk ++)
+    {
+        chunk_key(name, chunk, key);
+        uBit.storage.remove(key);
+    }
+    return MICROBIT_OK;
+}
@@ -0,0 +1,30 @@
+#ifndef UDRIVER_PCA9685_CHECKPOINT
+#define UDRIVER_PCA9685_CHECKPOINT
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_CHECKPOINT_CHUNK 32 /* Largest value in storage */
+#define UDRIVER_PCA9685_CHECKPOINT_CHUNKS 6
+#define UDRIVER_PCA9685_CHECKPOINT_NAME_MAX 14 /* Leaves room for the chunk */
+namespace UDriver_PCA9685 
+{
+    /* Checkpoints of a PCA9685's state, see PCA9685::save_state(), in the
+     * MicroBit's flash storage. Values in storage are limited to 32 bytes, 
+     * so a checkpoint is split over several keys named after it.
+    */
+    namespace Checkpoint
+    {
+        /* Save the device's state under the given name of up to 14 
+         * characters. Only the keys that changed are rewritten, sparing the
+         * flash when the state is saved often. */
+        int save(PCA9685 &device, const char *name);
+
+        /* Bring the device back to the state saved under the given name.
+         * Returns MICROBIT_NO_DATA if there is no valid checkpoint. */
+        int restore(PCA9685 &device, const char *name);
+
+        /* Remove the checkpoint saved under the given name */
+        int remove(const char *name);
+    }
+}
+#endif /* ifndef UDRIVER_PCA9685_CHECKPOINT */
@@ -0,0 +1,178 @@
+/*
+ * udriver_pca9685_daemon.cpp
+ * Shared frame regions and their writing daemon for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_daemon.h"
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+FrameRegion::FrameRegion()
+{
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++) this->values[pin] = 0;
+}
+
+void FrameRegion::write(Pin pin, uint16_t value)
+{
+    this->write_burst(pin, &value, 1);
+}
+
+void FrameRegion::write_burst(Pin pin, const uint16_t *values, int count)
+{
+    if(count <= 0 || pin + count > UDRIVER_PCA9685_PIN_COUNT) return;
+
+    //Writers may interrupt each other, so writes are held off interrupts
+    __disable_irq();
+    this->seq ++;
+    uint16_t mask = 0;
+    for(int i = 0; i < count; i ++)
+    {
+        this->values[pin + i] = values[i];
+        mask |= (1 << (pin + i));
+    }
+    if(this->dirty == 0) this->dirty_since_us = system_timer_current_time_us();
+    this->dirty |= mask;
+    this->seq ++;
+    __enable_irq();
+}
+
+uint16_t FrameRegion::snapshot(uint16_t *values, uint32_t *since_us)
+{
+    while(true)
+    {
+        uint32_t seq = this->seq;
+        if(this->dirty == 0) return 0;
+        
+        uint16_t dirty = this->dirty;
+        *since_us = this->dirty_since_us;
+        for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++) 
+            values[pin] = this->values[pin];
+
+        //Only clear what was read if no write landed in between
+        __disable_irq();
+        bool intact = !(seq & 1) && this->seq == seq;
+        if(intact) this->dirty = 0;
+        __enable_irq();
+        
+        if(intact) return dirty;
+        this->retries ++;
+    }
+}
+
+void FrameRegion::restore(uint16_t mask, uint32_t since_us)
+{
+    __disable_irq();
+    //Keep the older of the two times, allowing for the timer wrapping
+    if(this->dirty == 0 || (int32_t)(since_us - this->dirty_since_us) < 0) 
+        this->dirty_since_us = since_us;
+    this->dirty |= mask;
+    __enable_irq();
+}
+
+FrameDaemon::FrameDaemon()
+{
+    this->reset_stats();
+}
+
+FrameDaemon::~FrameDaemon()
+{
+    //The daemon fiber holds a pointer to this, so join it like BusExecutor
+    this->stop();
+    while(this->fiber_active) fiber_sleep(1);
+}
+
+int FrameDaemon::attach(PCA9685 &device, FrameRegion &region)
+{
+    if(this->device_count == UDRIVER_PCA9685_DAEMON_DEVICES) return MICROBIT_NO_RESOURCES;
+
+    this->devices[this->device_count] = &device;
+    this->regions[this->device_count] = &region;
+    this->device_count ++;
+    return MICROBIT_OK;
+}
+
+void FrameDaemon::start(int period_ms)
+{
+    this->period_ms = period_ms;
+    if(this->running) return;
+    
+    //Never leave two daemon fibers serving the regions
+    while(this->fiber_active) fiber_sleep(1);
+    this->running = true;
+    this->fiber_active = true;
+    create_fiber(daemon_main, this);
+}
+
+void FrameDaemon::stop()
+{
+    this->running = false;
+}
+
+void FrameDaemon::daemon_main(void *param)
+{
+    FrameDaemon *daemon = (FrameDaemon *)param;
+    while(daemon->running)
+    {
+        daemon->service();
+        fiber_sleep(daemon->period_ms);
+    }
+    daemon->fiber_active = false;
+}
+
+int FrameDaemon::service()
+{
+    int updates = 0;
+    int error = MICROBIT_OK;
+    for(int i = 0; i < this->device_count; i ++)
+    {
+        uint16_t values[UDRIVER_PCA9685_PIN_COUNT];
+        uint32_t since_us;
+        uint16_t dirty = this->regions[i]->snapshot(values, &since_us);
+        
+        //One burst per run of consecutive PWM Pins, leaving the others alone
+        int pin = 0;
+        while(dirty != 0 && pin < UDRIVER_PCA9685_PIN_COUNT)
+        {
+            if(!(dirty & (1 << pin)))
+            {
+                pin ++;
+                continue;
+            }
+
+            int start = pin;
+            while(pin < UDRIVER_PCA9685_PIN_COUNT && (dirty & (1 << pin))) pin ++;
+            int status = this->devices[i]->pwm_write_burst((Pin)start, 
+                values + start, pin - start);
+            if(status != MICROBIT_OK) 
+            {
+                //Hand this run and the ones after it back for the next pass
+                this->regions[i]->restore(dirty & ~((1 << start) - 1), since_us);
+                this->stats.errors ++;
+                if(error == MICROBIT_OK) error = status;
+                break;
+            }
+
+            uint32_t latency_us = (uint32_t)system_timer_current_time_us() - since_us;
+            this->stats.latency_max_us = (latency_us > this->stats.latency_max_us)
+                ? latency_us : this->stats.latency_max_us;
+            this->stats.latency_total_us += latency_us;
+            this->stats.bursts ++;
+            updates += pin - start;
+        }
+    }
+
+    this->stats.passes ++;
+    this->stats.updates += updates;
+    return (error == MICROBIT_OK) ? updates : error;
+}
+
+const DaemonStats &FrameDaemon::get_stats()
+{
+    return this->stats;
+}
+
+void FrameDaemon::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(DaemonStats));
+}
@@ -0,0 +1,104 @@
+#ifndef UDRIVER_PCA9685_DAEMON
+#define UDRIVER_PCA9685_DAEMON
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_DAEMON_DEVICES 8
+#define UDRIVER_PCA9685_DAEMON_PERIOD_MS 6 /* One system tick */
+namespace UDriver_PCA9685 
+{
+    /* PWM values of every PWM Pin of one PCA9685, shared between any number
+     * of writers, such as separate motion, lighting and safety fibers or 
+     * interrupt handlers, and a FrameDaemon. Writes are plain stores that 
+     * never touch the bus. The daemon reads the frame lock free under a 
+     * sequence lock, retrying a read torn by an interrupting writer.
+    */
+    class FrameRegion
+    {
+    public:
+        FrameRegion();
+
+        /* Writer: set the PWM value between 0-4095 of the given PWM Pin */
+        void write(Pin pin, uint16_t value);
+
+        /* Writer: set 'count' PWM values of consecutive PWM Pins starting at
+         * the given PWM Pin */
+        void write_burst(Pin pin, const uint16_t *values, int count);
+
+        /* Reader: copy the values and take the mask of the PWM Pins written
+         * since the last snapshot, with when the oldest was written. 
+         * Returns the mask, 0 if nothing changed. */
+        uint16_t snapshot(uint16_t *values, uint32_t *since_us);
+
+        /* Reader: hand back the PWM Pins in 'mask' of a snapshot that could
+         * not be written, to be taken again by the next snapshot */
+        void restore(uint16_t mask, uint32_t since_us);
+
+        /* Reads retried because a writer interrupted them */
+        uint32_t retries = 0;
+
+    protected:
+        volatile uint32_t seq = 0; /* Odd while a write is in progress */
+        volatile uint16_t dirty = 0;
+        volatile uint32_t dirty_since_us = 0;
+        volatile uint16_t values[UDRIVER_PCA9685_PIN_COUNT];
+    };
+
+    /* Latency from a write to its burst reported by the FrameDaemon */
+    typedef struct daemon_stats_t
+    {
+        uint32_t passes; /* Passes over the regions */
+        uint32_t bursts; /* i2c bursts sent */
+        uint32_t updates; /* PWM Pins written */
+        uint32_t errors; /* Failed bursts, left for the next pass */
+        uint32_t latency_max_us;
+        uint64_t latency_total_us; /* Divide by bursts for the average */
+    }DaemonStats;
+
+    /* Fiber that watches the FrameRegion of each PCA9685 and writes only the
+     * PWM Pins that changed, one burst per run of consecutive PWM Pins.
+    */
+    class FrameDaemon
+    {
+    public:
+        FrameDaemon();
+
+        /* Stop the daemon fiber, returning once it has exited.
+         * NOTE: Must run in a fiber, not an interrupt. */
+        ~FrameDaemon();
+
+        /* Watch the region for the device. Returns MICROBIT_NO_RESOURCES if
+         * UDRIVER_PCA9685_DAEMON_DEVICES devices are already watched. */
+        int attach(PCA9685 &device, FrameRegion &region);
+
+        /* Start the daemon fiber, passing over the regions every 'period_ms'.
+         * If a stopped daemon fiber has not exited yet, waits for it first.
+         * NOTE: Must be called from a fiber, not an interrupt. */
+        void start(int period_ms=UDRIVER_PCA9685_DAEMON_PERIOD_MS);
+
+        /* Stop the daemon fiber after its current pass */
+        void stop();
+
+        /* Pass over the regions once, writing what changed. Called by the
+         * daemon fiber, or directly when not started. PWM Pins of a failed
+         * burst are left dirty for the next pass, and the other devices are
+         * still written. Returns the number of PWM Pins written, or the 
+         * first error status. */
+        int service();
+
+        const DaemonStats &get_stats();
+        void reset_stats();
+
+    protected:
+        PCA9685 *devices[UDRIVER_PCA9685_DAEMON_DEVICES];
+        FrameRegion *regions[UDRIVER_PCA9685_DAEMON_DEVICES];
+        int device_count = 0;
+        int period_ms = UDRIVER_PCA9685_DAEMON_PERIOD_MS;
+        volatile bool running = false;
+        volatile bool fiber_active = false; /* Until the daemon fiber exits */
+        DaemonStats stats;
+
+        static void daemon_main(void *param);
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_DAEMON */
@@ -0,0 +1,122 @@
+/*
+ * udriver_pca9685_dither.cpp
+ * Temporal dithering engine for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_dither.h"
+
+#define DITHER_BITS 4 /* 16 bit levels on 12 bit PWM */
+#define DITHER_MASK ((1 << DITHER_BITS) - 1)
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+DitherEngine::DitherEngine(PCA9685 &device) : device(device)
+{
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        this->level[pin] = 0;
+        this->written[pin] = 0;
+        this->error[pin] = 0;
+        this->fresh[pin] = true;
+    }
+    this->reset_stats();
+}
+
+void DitherEngine::set_level(Pin pin, uint16_t level)
+{
+    this->level[pin] = level;
+    this->active |= (1 << pin);
+}
+
+void DitherEngine::set_levels(Pin pin, const uint16_t *levels, int count)
+{
+    if(count <= 0 || pin + count > UDRIVER_PCA9685_PIN_COUNT) return;
+
+    for(int i = 0; i < count; i ++) this->set_level((Pin)(pin + i), levels[i]);
+}
+
+void DitherEngine::release(Pin pin)
+{
+    this->active &= ~(1 << pin);
+    this->error[pin] = 0;
+}
+
+int DitherEngine::frame()
+{
+    uint64_t now_us = system_timer_current_time_us();
+    if(now_us < this->boundary_us) return 0;
+
+    uint32_t period_us = 1000000UL / this->device.get_pwm_frequency();
+    this->boundary_us = now_us - (now_us % period_us) + period_us;
+    return this->frame_now();
+}
+
+int DitherEngine::frame_now()
+{
+    uint16_t changed = 0;
+    uint16_t next[UDRIVER_PCA9685_PIN_COUNT];
+    memcpy(next, this->written, sizeof(next));
+
+    this->stats.frames ++;
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        if(!(this->active & (1 << pin))) continue;
+
+        //Error diffusion: round down, carrying the remainder to next period
+        uint32_t sum = (uint32_t)this->level[pin] + this->error[pin];
+        uint32_t value = sum >> DITHER_BITS;
+        if(value > UDRIVER_PCA9685_PWM_MAX) 
+        {
+            value = UDRIVER_PCA9685_PWM_MAX;
+            this->error[pin] = 0;
+        }
+        else this->error[pin] = sum & DITHER_MASK;
+
+        if(value == this->written[pin] && !this->fresh[pin]) continue;
+        next[pin] = value;
+        changed |= (1 << pin);
+    }
+
+    //One burst per run of dithered PWM Pins, spanning the changed ones and 
+    //resending unchanged ones in between, as that is cheaper than starting
+    //another transaction
+    int sent = 0;
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; )
+    {
+        if(!(changed & (1 << pin))) { pin ++; continue; }
+        
+        int first = pin;
+        int last = pin;
+        for(; pin < UDRIVER_PCA9685_PIN_COUNT && (this->active & (1 << pin)); pin ++)
+            if(changed & (1 << pin)) last = pin;
+
+        int count = last - first + 1;
+        int status = this->device.pwm_write_burst((Pin)first, next + first, count);
+        if(status != MICROBIT_OK)
+        {
+            //Unsent PWM Pins still differ from written[], so are resent next frame
+            this->stats.errors ++;
+            return status;
+        }
+        for(int i = first; i <= last; i ++)
+        {
+            this->written[i] = next[i];
+            this->fresh[i] = false;
+        }
+        this->stats.bursts ++;
+        this->stats.bytes += count * UDRIVER_PCA9685_CHANNEL_BYTES + 1;
+        sent += count;
+    }
+    return sent;
+}
+
+const DitherStats &DitherEngine::get_stats()
+{
+    return this->stats;
+}
+
+void DitherEngine::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(DitherStats));
+}
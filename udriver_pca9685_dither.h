@@ -0,0 +1,64 @@
+#ifndef UDRIVER_PCA9685_DITHER
+#define UDRIVER_PCA9685_DITHER
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_LEVEL_MAX 65535 /* 16 bit dither target levels */
+namespace UDriver_PCA9685 
+{
+    /* Counters reported by the DitherEngine */
+    typedef struct dither_stats_t
+    {
+        uint32_t frames; /* PWM periods processed */
+        uint32_t bursts; /* i2c bursts sent */
+        uint32_t bytes; /* Register bytes sent */
+        uint32_t errors; /* Failed bursts, resent next frame */
+    }DitherStats;
+
+    /* Temporal dithering for PWM Pins driving LEDs, giving 16 bit levels on
+     * the PCA9685's 12 bit PWM. Each PWM period the engine alternates between
+     * the two nearest 12 bit values, carrying the rounding error forward so
+     * the average over time matches the level. 
+     * All changes of a period are sent in one burst.
+    */
+    class DitherEngine
+    {
+    public:
+        DitherEngine(PCA9685 &device);
+
+        /* Set the 16 bit level between 0-65535 the given PWM Pin should
+         * average to, starting to dither that PWM Pin */
+        void set_level(Pin pin, uint16_t level);
+
+        /* Set the 16 bit levels of 'count' consecutive PWM Pins, starting 
+         * at the given PWM Pin */
+        void set_levels(Pin pin, const uint16_t *levels, int count);
+
+        /* Stop dithering the given PWM Pin, leaving its last value */
+        void release(Pin pin);
+
+        /* Advance one PWM period if a PWM period has passed since the last 
+         * frame, sending the changed PWM Pins in a single burst.
+         * Call this from the control loop at least once per PWM period.
+         * Returns the number of PWM Pins sent, or an error status. */
+        int frame();
+
+        /* Advance one PWM period immediately.
+         * Returns the number of PWM Pins sent, or an error status. */
+        int frame_now();
+
+        const DitherStats &get_stats();
+        void reset_stats();
+
+    protected:
+        PCA9685 &device;
+        uint64_t boundary_us = 0;
+        uint16_t active = 0;
+        uint16_t level[UDRIVER_PCA9685_PIN_COUNT];
+        uint16_t written[UDRIVER_PCA9685_PIN_COUNT];
+        uint8_t error[UDRIVER_PCA9685_PIN_COUNT]; /* Carried 4 bit remainder */
+        bool fresh[UDRIVER_PCA9685_PIN_COUNT]; /* No value written yet */
+        DitherStats stats;
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_DITHER */
@@ -0,0 +1,162 @@
+/*
+ * udriver_pca9685_executor.cpp
+ * Multi bus executor for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_executor.h"
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+/* Event values are handed out so several executors can share the event id */
+static uint16_t next_event_value = 1;
+
+BusExecutor::BusExecutor()
+{
+    this->done_value = next_event_value ++;
+    this->reset_stats();
+}
+
+BusExecutor::~BusExecutor()
+{
+    this->shutdown();
+}
+
+void BusExecutor::worker_main(void *param)
+{
+    Worker *worker = (Worker *)param;
+    BusExecutor *owner = worker->owner;
+
+    while(true)
+    {
+        worker->waiting = true;
+        fiber_wait_for_event(UDRIVER_PCA9685_EXECUTOR_EVT_ID, worker->start_value);
+        worker->waiting = false;
+
+        if(owner->stopping)
+        {
+            //Nothing of the worker is touched once the barrier is released
+            if(-- owner->outstanding == 0) 
+                MicroBitEvent(UDRIVER_PCA9685_EXECUTOR_EVT_ID, owner->done_value);
+            return;
+        }
+
+        for(int i = 0; i < worker->job_count; i ++)
+        {
+            Job &job = worker->jobs[i];
+            int status = job.device->pwm_write_burst((Pin)job.pin, job.values, job.count);
+            if(status != MICROBIT_OK)
+            {
+                owner->stats.errors ++;
+                owner->status = status;
+                continue;
+            }
+            owner->stats.updates += job.count;
+        }
+        worker->job_count = 0;
+
+        //Barrier: the last worker to finish releases commit()
+        if(-- owner->outstanding == 0) 
+            MicroBitEvent(UDRIVER_PCA9685_EXECUTOR_EVT_ID, owner->done_value);
+    }
+}
+
+int BusExecutor::stage(PCA9685 &device, Pin pin, const uint16_t *values, int count)
+{
+    if(count <= 0 || pin + count > UDRIVER_PCA9685_PIN_COUNT) 
+        return MICROBIT_INVALID_PARAMETER;
+
+    //Find or start the worker for the device's bus
+    int index = 0;
+    while(index < this->worker_count && this->workers[index].bus != &device.get_bus()) 
+        index ++;
+    if(index == this->worker_count)
+    {
+        if(this->worker_count == UDRIVER_PCA9685_EXECUTOR_BUSES) 
+            return MICROBIT_NO_RESOURCES;
+
+        Worker &worker = this->workers[this->worker_count ++];
+        worker.owner = this;
+        worker.bus = &device.get_bus();
+        worker.job_count = 0;
+        worker.waiting = false;
+        worker.start_value = next_event_value ++;
+        create_fiber(worker_main, &worker);
+    }
+
+    Worker &worker = this->workers[index];
+    if(worker.job_count == UDRIVER_PCA9685_EXECUTOR_JOBS) return MICROBIT_NO_RESOURCES;
+
+    Job &job = worker.jobs[worker.job_count ++];
+    job.device = &device;
+    job.pin = pin;
+    job.count = count;
+    memcpy(job.values, values, count * sizeof(uint16_t));
+    return MICROBIT_OK;
+}
+
+int BusExecutor::commit()
+{
+    uint64_t start_us = system_timer_current_time_us();
+    uint32_t updates = this->stats.updates;
+    this->status = MICROBIT_OK;
+    
+    //Workers only just created may not have reached their wait yet
+    int busy = 0;
+    for(int i = 0; i < this->worker_count; i ++)
+    {
+        if(this->workers[i].job_count == 0) continue;
+        while(!this->workers[i].waiting) schedule();
+        busy ++;
+    }
+
+    //Workers only run once this fiber waits below, so none can finish early
+    this->outstanding = busy;
+    for(int i = 0; i < this->worker_count; i ++)
+    {
+        if(this->workers[i].job_count == 0) continue;
+        MicroBitEvent(UDRIVER_PCA9685_EXECUTOR_EVT_ID, this->workers[i].start_value);
+    }
+    if(this->outstanding > 0)
+        fiber_wait_for_event(UDRIVER_PCA9685_EXECUTOR_EVT_ID, this->done_value);
+
+    uint32_t frame_us = system_timer_current_time_us() - start_us;
+    this->stats.frames ++;
+    this->stats.last_frame_us = frame_us;
+    this->stats.max_frame_us = (frame_us > this->stats.max_frame_us) 
+        ? frame_us : this->stats.max_frame_us;
+    if(this->status != MICROBIT_OK) return this->status;
+    return this->stats.updates - updates;
+}
+
+void BusExecutor::shutdown()
+{
+    if(this->worker_count == 0) return;
+
+    for(int i = 0; i < this->worker_count; i ++)
+        while(!this->workers[i].waiting) schedule();
+
+    this->stopping = true;
+    this->outstanding = this->worker_count;
+    for(int i = 0; i < this->worker_count; i ++)
+        MicroBitEvent(UDRIVER_PCA9685_EXECUTOR_EVT_ID, this->workers[i].start_value);
+    fiber_wait_for_event(UDRIVER_PCA9685_EXECUTOR_EVT_ID, this->done_value);
+
+    this->worker_count = 0;
+    this->stopping = false;
+}
+
+int BusExecutor::bus_count()
+{
+    return this->worker_count;
+}
+
+const ExecutorStats &BusExecutor::get_stats()
+{
+    return this->stats;
+}
+
+void BusExecutor::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(ExecutorStats));
+}
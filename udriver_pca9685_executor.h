@@ -0,0 +1,89 @@
+#ifndef UDRIVER_PCA9685_EXECUTOR
+#define UDRIVER_PCA9685_EXECUTOR
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_EXECUTOR_BUSES 4
+#define UDRIVER_PCA9685_EXECUTOR_JOBS 8 /* Staged writes per bus per frame */
+#define UDRIVER_PCA9685_EXECUTOR_EVT_ID 9685 /* Message bus id for workers */
+namespace UDriver_PCA9685 
+{
+    /* Counters reported by the BusExecutor */
+    typedef struct executor_stats_t
+    {
+        uint32_t frames; /* Frames committed */
+        uint32_t updates; /* PWM Pins written over all buses */
+        uint32_t errors; /* Failed bursts, dropped with their frame */
+        uint32_t last_frame_us; /* Time taken by the last commit() */
+        uint32_t max_frame_us;
+    }ExecutorStats;
+
+    /* Drives PCA9685s spread over several i2c buses, with one worker fiber
+     * per bus. Writes are staged for the next frame, then commit() hands each
+     * bus's writes to its worker and waits until every bus is done. The i2c
+     * driver blocks the CPU while it transfers, so the buses are served one
+     * after another rather than concurrently; commit() returns only once the
+     * whole frame is out. The workers are stopped and joined by shutdown()
+     * or when the executor is destroyed.
+     * NOTE: commit() and shutdown() must be called from a fiber, not an 
+     * interrupt.
+    */
+    class BusExecutor
+    {
+    public:
+        BusExecutor();
+        ~BusExecutor();
+
+        /* Stage a PWM write of 'count' values between 0-4095 to consecutive
+         * PWM Pins on the device, starting at the given PWM Pin, for the next
+         * frame. Returns MICROBIT_OK, or MICROBIT_NO_RESOURCES if the device's
+         * bus has no room left in this frame.
+        */
+        int stage(PCA9685 &device, Pin pin, const uint16_t *values, int count);
+
+        /* Write the staged frame on all buses, returning once every bus has
+         * finished. Returns the number of PWM Pins written, or an error 
+         * status if a burst failed. */
+        int commit();
+
+        /* Stop the workers, returning once every one has exited. Writes 
+         * staged since the last commit() are dropped. */
+        void shutdown();
+
+        /* Number of buses with a worker */
+        int bus_count();
+
+        const ExecutorStats &get_stats();
+        void reset_stats();
+
+    protected:
+        typedef struct job_t
+        {
+            PCA9685 *device;
+            uint16_t values[UDRIVER_PCA9685_PIN_COUNT];
+            uint8_t pin;
+            uint8_t count;
+        }Job;
+
+        typedef struct worker_t
+        {
+            BusExecutor *owner;
+            I2CBus *bus;
+            Job jobs[UDRIVER_PCA9685_EXECUTOR_JOBS];
+            uint16_t start_value; /* Event value that starts this worker */
+            uint8_t job_count;
+            bool waiting;
+        }Worker;
+
+        Worker workers[UDRIVER_PCA9685_EXECUTOR_BUSES];
+        int worker_count = 0;
+        int outstanding = 0; /* Workers yet to finish the frame or exit */
+        bool stopping = false;
+        int status = MICROBIT_OK; /* Last error of the frame being written */
+        uint16_t done_value; /* Event value raised when a frame is done */
+        ExecutorStats stats;
+
+        static void worker_main(void *param);
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_EXECUTOR */
@@ -0,0 +1,163 @@
+/*
+ * udriver_pca9685_gamma.cpp
+ * Brightness curve lookup tables for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_gamma.h"
+
+/* Tables sample the curve at 257 points over the full brightness range
+ * NOTE: Generated offline, x = i / 256 */
+#define BRIGHTNESS_TABLE_SIZE 257
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+/* Gamma 2.2: round(4095 * x^2.2) */
+static const uint16_t gamma22_table[BRIGHTNESS_TABLE_SIZE] = 
+{
+       0,    0,    0,    0,    0,    1,    1,    1,    2,    3,    3,    4,
+       5,    6,    7,    8,    9,   10,   12,   13,   15,   17,   19,   20,
+      22,   25,   27,   29,   31,   34,   37,   39,   42,   45,   48,   51,
+      55,   58,   62,   65,   69,   73,   77,   81,   85,   89,   94,   98,
+     103,  108,  113,  118,  123,  128,  133,  139,  145,  150,  156,  162,
+     168,  175,  181,  187,  194,  201,  208,  215,  222,  229,  236,  244,
+     251,  259,  267,  275,  283,  291,  300,  308,  317,  326,  335,  344,
+     353,  362,  372,  381,  391,  401,  411,  421,  431,  441,  452,  463,
+     473,  484,  495,  506,  518,  529,  541,  553,  564,  576,  589,  601,
+     613,  626,  639,  651,  664,  677,  691,  704,  718,  731,  745,  759,
+     773,  788,  802,  816,  831,  846,  861,  876,  891,  907,  922,  938,
+     954,  970,  986, 1002, 1018, 1035, 1052, 1068, 1085, 1103, 1120, 1137,
+    1155, 1173, 1190, 1208, 1227, 1245, 1263, 1282, 1301, 1320, 1339, 1358,
+    1377, 1397, 1416, 1436, 1456, 1476, 1496, 1517, 1537, 1558, 1579, 1600,
+    1621, 1642, 1664, 1685, 1707, 1729, 1751, 1773, 1796, 1818, 1841, 1864,
+    1887, 1910, 1933, 1957, 1980, 2004, 2028, 2052, 2076, 2101, 2125, 2150,
+    2175, 2200, 2225, 2250, 2276, 2301, 2327, 2353, 2379, 2405, 2432, 2458,
+    2485, 2512, 2539, 2566, 2593, 2621, 2649, 2676, 2704, 2733, 2761, 2789,
+    2818, 2847, 2876, 2905, 2934, 2963, 2993, 3023, 3053, 3083, 3113, 3143,
+    3174, 3205, 3235, 3266, 3298, 3329, 3360, 3392, 3424, 3456, 3488, 3520,
+    3553, 3586, 3618, 3651, 3685, 3718, 3751, 3785, 3819, 3853, 3887, 3921,
+    3956, 3990, 4025, 4060, 4095
+};
+
+/* Gamma 2.8: round(4095 * x^2.8) */
+static const uint16_t gamma28_table[BRIGHTNESS_TABLE_SIZE] = 
+{
+       0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    0,    1,
+       1,    1,    1,    1,    2,    2,    2,    3,    3,    4,    4,    5,
+       5,    6,    7,    8,    8,    9,   10,   11,   12,   13,   14,   16,
+      17,   18,   20,   21,   23,   24,   26,   28,   30,   31,   33,   36,
+      38,   40,   42,   45,   47,   50,   52,   55,   58,   61,   64,   67,
+      70,   74,   77,   81,   84,   88,   92,   96,  100,  104,  109,  113,
+     117,  122,  127,  132,  137,  142,  147,  152,  158,  163,  169,  175,
+     181,  187,  193,  199,  206,  213,  219,  226,  233,  240,  248,  255,
+     263,  270,  278,  286,  295,  303,  311,  320,  329,  338,  347,  356,
+     365,  375,  385,  395,  405,  415,  425,  436,  446,  457,  468,  479,
+     491,  502,  514,  526,  538,  550,  563,  575,  588,  601,  614,  627,
+     641,  655,  668,  683,  697,  711,  726,  741,  756,  771,  786,  802,
+     818,  834,  850,  866,  883,  900,  917,  934,  951,  969,  987, 1005,
+    1023, 1042, 1060, 1079, 1098, 1118, 1137, 1157, 1177, 1197, 1218, 1238,
+    1259, 1280, 1301, 1323, 1345, 1367, 1389, 1412, 1434, 1457, 1480, 1504,
+    1527, 1551, 1575, 1600, 1624, 1649, 1674, 1700, 1725, 1751, 1777, 1803,
+    1830, 1857, 1884, 1911, 1939, 1966, 1995, 2023, 2051, 2080, 2109, 2139,
+    2168, 2198, 2228, 2259, 2290, 2321, 2352, 2383, 2415, 2447, 2479, 2512,
+    2545, 2578, 2611, 2645, 2679, 2713, 2748, 2783, 2818, 2853, 2889, 2925,
+    2961, 2997, 3034, 3071, 3108, 3146, 3184, 3222, 3261, 3300, 3339, 3378,
+    3418, 3458, 3498, 3539, 3580, 3621, 3663, 3705, 3747, 3789, 3832, 3875,
+    3918, 3962, 4006, 4050, 4095
+};
+
+/* CIE 1931 lightness: round(4095 * Y(L* = 100x)) */
+static const uint16_t cie1931_table[BRIGHTNESS_TABLE_SIZE] = 
+{
+       0,    2,    4,    5,    7,    9,   11,   12,   14,   16,   18,   19,
+      21,   23,   25,   27,   28,   30,   32,   34,   35,   37,   39,   41,
+      43,   45,   47,   49,   51,   54,   56,   58,   61,   63,   66,   69,
+      71,   74,   77,   80,   83,   86,   89,   93,   96,   99,  103,  106,
+     110,  114,  118,  122,  126,  130,  134,  138,  143,  147,  152,  156,
+     161,  166,  171,  176,  181,  186,  191,  197,  202,  208,  214,  219,
+     225,  231,  238,  244,  250,  257,  263,  270,  277,  284,  291,  298,
+     305,  313,  320,  328,  335,  343,  351,  359,  368,  376,  384,  393,
+     402,  411,  420,  429,  438,  447,  457,  467,  476,  486,  496,  507,
+     517,  527,  538,  549,  560,  571,  582,  593,  605,  616,  628,  640,
+     652,  664,  677,  689,  702,  715,  728,  741,  754,  768,  781,  795,
+     809,  823,  837,  852,  867,  881,  896,  911,  927,  942,  958,  973,
+     989, 1006, 1022, 1038, 1055, 1072, 1089, 1106, 1123, 1141, 1159, 1177,
+    1195, 1213, 1232, 1250, 1269, 1288, 1307, 1327, 1346, 1366, 1386, 1406,
+    1427, 1447, 1468, 1489, 1510, 1532, 1553, 1575, 1597, 1619, 1642, 1664,
+    1687, 1710, 1733, 1757, 1780, 1804, 1828, 1852, 1877, 1902, 1927, 1952,
+    1977, 2003, 2028, 2054, 2081, 2107, 2134, 2161, 2188, 2215, 2243, 2270,
+    2299, 2327, 2355, 2384, 2413, 2442, 2472, 2501, 2531, 2561, 2592, 2622,
+    2653, 2684, 2716, 2747, 2779, 2811, 2843, 2876, 2909, 2942, 2975, 3009,
+    3042, 3077, 3111, 3145, 3180, 3215, 3251, 3286, 3322, 3358, 3395, 3431,
+    3468, 3505, 3543, 3580, 3618, 3657, 3695, 3734, 3773, 3812, 3852, 3892,
+    3932, 3972, 4013, 4054, 4095
+};
+
+static const uint16_t *curve_table(BrightnessCurve curve)
+{
+    switch(curve)
+    {
+        case Curve_Gamma22: return gamma22_table;
+        case Curve_Gamma28: return gamma28_table;
+        case Curve_CIE1931: return cie1931_table;
+        default: return NULL;
+    }
+}
+
+static inline uint16_t curve_map(const uint16_t *table, int brightness)
+{
+    if(brightness <= 0) return 0;
+    if(brightness >= UDRIVER_PCA9685_BRIGHTNESS_MAX) return UDRIVER_PCA9685_PWM_MAX;
+    if(table == NULL) 
+        return brightness * UDRIVER_PCA9685_PWM_MAX / UDRIVER_PCA9685_BRIGHTNESS_MAX;
+
+    //Position along the table in 1/256ths of an entry: b * 256 * 256 / 1023
+    uint32_t pos = ((uint32_t)brightness * 65600 + 512) >> 10;
+    uint32_t index = pos >> 8;
+    uint32_t frac = pos & 0xFF;
+    
+    uint32_t low = table[index];
+    uint32_t high = table[index + 1];
+    return low + (((high - low) * frac) >> 8);
+}
+
+BrightnessMap::BrightnessMap(BrightnessCurve curve)
+{
+    this->set_curve_group(0xFFFF, curve);
+}
+
+void BrightnessMap::set_curve(Pin pin, BrightnessCurve curve)
+{
+    this->table[pin] = curve_table(curve);
+}
+
+void BrightnessMap::set_curve_group(uint16_t pins, BrightnessCurve curve)
+{
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+        if(pins & (1 << pin)) this->table[pin] = curve_table(curve);
+}
+
+uint16_t BrightnessMap::map(Pin pin, int brightness)
+{
+    return curve_map(this->table[pin], brightness);
+}
+
+void BrightnessMap::encode(Pin pin, const uint16_t *brightness, uint8_t *regs, 
+        int count)
+{
+    for(int i = 0; i < count; i ++)
+    {
+        PCA9685::encode_channel(0, curve_map(this->table[pin + i], brightness[i]),
+            regs + i * UDRIVER_PCA9685_CHANNEL_BYTES);
+    }
+}
+
+void BrightnessMap::write(PCA9685 &device, Pin pin, const uint16_t *brightness, 
+        int count)
+{
+    uint8_t regs[UDRIVER_PCA9685_PIN_COUNT * UDRIVER_PCA9685_CHANNEL_BYTES];
+    if(count <= 0 || pin + count > UDRIVER_PCA9685_PIN_COUNT) return;
+
+    this->encode(pin, brightness, regs, count);
+    device.channel_write_burst(pin, regs, count);
+}
@@ -0,0 +1,51 @@
+#ifndef UDRIVER_PCA9685_GAMMA
+#define UDRIVER_PCA9685_GAMMA
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_BRIGHTNESS_MAX 1023
+namespace UDriver_PCA9685 
+{
+    /* Defines the brightness curves mapping perceived brightness to PWM */
+    typedef enum brightness_curve_t
+    {
+        Curve_Linear = 0,
+        Curve_Gamma22 = 1,
+        Curve_Gamma28 = 2,
+        Curve_CIE1931 = 3
+    }BrightnessCurve;
+
+    /* Maps brightness values between 0-1023 to PWM values between 0-4095 
+     * through a brightness curve per PWM Pin, using lookup tables built at
+     * compile time with integer interpolation.
+    */
+    class BrightnessMap
+    {
+    public:
+        /* Construct a map with every PWM Pin on the given curve */
+        BrightnessMap(BrightnessCurve curve=Curve_Linear);
+
+        /* Use the given curve for the given PWM Pin */
+        void set_curve(Pin pin, BrightnessCurve curve);
+
+        /* Use the given curve for the group of PWM Pins whose bits are set
+         * in 'pins', bit 0 being Pin_P0 */
+        void set_curve_group(uint16_t pins, BrightnessCurve curve);
+
+        /* Map a brightness between 0-1023 to a PWM value for the PWM Pin */
+        uint16_t map(Pin pin, int brightness);
+
+        /* Map the brightness of 'count' consecutive PWM Pins, starting at the
+         * given PWM Pin, straight into channel registers for 
+         * PCA9685::channel_write_burst() */
+        void encode(Pin pin, const uint16_t *brightness, uint8_t *regs, int count);
+
+        /* Write the brightness of 'count' consecutive PWM Pins, starting at 
+         * the given PWM Pin, to the device in a single burst */
+        void write(PCA9685 &device, Pin pin, const uint16_t *brightness, int count);
+
+    protected:
+        const uint16_t *table[UDRIVER_PCA9685_PIN_COUNT]; /* NULL for linear */
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_GAMMA */
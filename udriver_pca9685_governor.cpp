@@ -0,0 +1,108 @@
+/*
+ * udriver_pca9685_governor.cpp
+ * PWM period aware update governor for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_governor.h"
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+UpdateGovernor::UpdateGovernor(PCA9685 &device) : device(device)
+{
+    this->reset_stats();
+}
+
+uint32_t UpdateGovernor::period_us()
+{
+    return 1000000UL / this->device.get_pwm_frequency();
+}
+
+void UpdateGovernor::pwm_write(Pin pin, int value)
+{
+    if(value < UDRIVER_PCA9685_PWM_MIN || value > UDRIVER_PCA9685_PWM_MAX)
+        return;
+    
+    this->stats.requested ++;
+    if(this->dirty & (1 << pin)) 
+    {
+        //Merged with a write already waiting for this period
+        this->stats.suppressed ++;
+        this->stats.bytes_suppressed += UDRIVER_PCA9685_CHANNEL_BYTES;
+    }
+    
+    this->pending[pin] = value;
+    this->dirty |= (1 << pin);
+}
+
+int UpdateGovernor::flush()
+{
+    uint64_t now_us = system_timer_current_time_us();
+    if(now_us < this->boundary_us) return 0;
+    
+    //Align the next flush to the PWM period grid
+    uint32_t period = this->period_us();
+    this->boundary_us = now_us - (now_us % period) + period;
+    return this->flush_now();
+}
+
+int UpdateGovernor::flush_now()
+{
+    //Drop writes that would not change the registers on the PCA9685, 
+    //however they were last written
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        if(!(this->dirty & (1 << pin))) continue;
+        uint8_t regs[UDRIVER_PCA9685_CHANNEL_BYTES], cached[UDRIVER_PCA9685_CHANNEL_BYTES];
+        PCA9685::encode_channel(0, this->pending[pin], regs);
+        this->device.read_channel_cache((Pin)pin, cached);
+        if(memcmp(regs, cached, UDRIVER_PCA9685_CHANNEL_BYTES) == 0)
+        {
+            this->dirty &= ~(1 << pin);
+            this->stats.suppressed ++;
+            this->stats.bytes_suppressed += UDRIVER_PCA9685_CHANNEL_BYTES;
+        }
+    }
+    if(this->dirty == 0) return 0;
+
+    //Write each contiguous run of dirty PWM Pins as a single burst
+    int count = 0;
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; )
+    {
+        if(!(this->dirty & (1 << pin))) { pin ++; continue; }
+
+        int first = pin;
+        while(pin < UDRIVER_PCA9685_PIN_COUNT && (this->dirty & (1 << pin))) pin ++;
+        int status = this->device.pwm_write_burst((Pin)first, this->pending + first, 
+            pin - first);
+        if(status != MICROBIT_OK)
+        {
+            //This run and those after it stay pending for the next flush
+            this->stats.errors ++;
+            this->stats.written += count;
+            return status;
+        }
+        for(int written = first; written < pin; written ++) 
+            this->dirty &= ~(1 << written);
+        count += pin - first;
+    }
+
+    this->stats.written += count;
+    this->stats.flushes ++;
+    return count;
+}
+
+uint64_t UpdateGovernor::next_boundary_us()
+{
+    return this->boundary_us;
+}
+
+const GovernorStats &UpdateGovernor::get_stats()
+{
+    return this->stats;
+}
+
+void UpdateGovernor::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(GovernorStats));
+}
@@ -0,0 +1,58 @@
+#ifndef UDRIVER_PCA9685_GOVERNOR
+#define UDRIVER_PCA9685_GOVERNOR
+
+#include "udriver_pca9685.h"
+
+namespace UDriver_PCA9685 
+{
+    /* Counters reported by the UpdateGovernor */
+    typedef struct governor_stats_t
+    {
+        uint32_t requested; /* PWM writes requested */
+        uint32_t written; /* PWM Pins actually written to the PCA9685 */
+        uint32_t suppressed; /* Requests merged or unchanged, never sent */
+        uint32_t flushes; /* Periods in which anything was written */
+        uint32_t bytes_suppressed; /* i2c bytes saved by suppression */
+        uint32_t errors; /* Failed bursts, left pending */
+    }GovernorStats;
+
+    /* Holds back PWM writes to a PCA9685 so each PWM Pin is written at most
+     * once per PWM period, as the PCA9685 only latches new values at the end
+     * of a cycle. Writes made in between are merged, keeping the last value,
+     * and values already in the PCA9685's registers are not sent again.
+    */
+    class UpdateGovernor
+    {
+    public:
+        UpdateGovernor(PCA9685 &device);
+
+        /* PWM write value between 0-4095 to the given PWM Pin, at the next
+         * PWM period boundary */
+        void pwm_write(Pin pin, int value);
+
+        /* Write any pending values if a PWM period boundary has passed 
+         * since the last flush. Call this from the control loop.
+         * Returns the number of PWM Pins written, or an error status. */
+        int flush();
+
+        /* Write any pending values immediately. Values of a failed burst stay
+         * pending. Returns the number of PWM Pins written, or an error status. */
+        int flush_now();
+
+        /* System time in microseconds of the next PWM period boundary */
+        uint64_t next_boundary_us();
+
+        const GovernorStats &get_stats();
+        void reset_stats();
+
+    protected:
+        PCA9685 &device;
+        uint64_t boundary_us = 0;
+        uint16_t dirty = 0;
+        uint16_t pending[UDRIVER_PCA9685_PIN_COUNT];
+        GovernorStats stats;
+
+        uint32_t period_us();
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_GOVERNOR */
@@ -0,0 +1,202 @@
+/*
+ * udriver_pca9685_ingest.cpp
+ * Streaming binary frame ingest for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_ingest.h"
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+#define PARSE_MORE 0 /* Frame incomplete */
+#define PARSE_BAD 1 /* Not a frame from the first byte */
+#define PARSE_DONE 2 /* Frame complete and valid */
+#define FRAME_LEN(count) (UDRIVER_PCA9685_INGEST_HEADER_BYTES + (count) * 2 + 2)
+
+SerialIngest::SerialIngest(PCA9685 **devices, int count) 
+    : devices(devices), device_count(count)
+{
+    this->reset_stats();
+}
+
+uint16_t SerialIngest::crc16(const uint8_t *data, int len, uint16_t crc)
+{
+    //Four bits at a time, trading a small table for half the iterations
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+    };
+    for(int i = 0; i < len; i ++)
+    {
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)];
+        crc = (crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)];
+    }
+    return crc;
+}
+
+int SerialIngest::encode(uint8_t device, Pin pin, const uint16_t *values, 
+        int count, uint8_t *frame)
+{
+    count = (count < 1) ? 1 : count;
+    count = (count > UDRIVER_PCA9685_PIN_COUNT) ? UDRIVER_PCA9685_PIN_COUNT : count;
+    
+    frame[0] = UDRIVER_PCA9685_INGEST_SYNC0;
+    frame[1] = UDRIVER_PCA9685_INGEST_SYNC1;
+    frame[2] = device;
+    frame[3] = pin;
+    frame[4] = count;
+    
+    int len = UDRIVER_PCA9685_INGEST_HEADER_BYTES;
+    for(int i = 0; i < count; i ++)
+    {
+        frame[len ++] = values[i] & 0xFF;
+        frame[len ++] = values[i] >> 8;
+    }
+
+    uint16_t crc = crc16(frame + 2, len - 2);
+    frame[len ++] = crc & 0xFF;
+    frame[len ++] = crc >> 8;
+    return len;
+}
+
+int SerialIngest::feed(const uint8_t *data, int len)
+{
+    int frames = 0;
+    for(int i = 0; i < len; i ++)
+    {
+        this->buffer[this->buffer_len ++] = data[i];
+        
+        int state;
+        while((state = this->parse()) != PARSE_MORE)
+        {
+            //Drop the frame or, if bad, resume at the next byte that could 
+            //start one, as a resync may leave a whole frame in the buffer
+            int used = 1;
+            if(state == PARSE_DONE)
+            {
+                this->enqueue();
+                used = FRAME_LEN(this->buffer[4]);
+                frames ++;
+            }
+            else this->stats.skipped ++;
+
+            this->buffer_len -= used;
+            memmove(this->buffer, this->buffer + used, this->buffer_len);
+        }
+    }
+    
+    this->stats.bytes += len;
+    return frames;
+}
+
+int SerialIngest::parse()
+{
+    const uint8_t *frame = this->buffer;
+    int len = this->buffer_len;
+    
+    if(len < 1) return PARSE_MORE;
+    if(frame[0] != UDRIVER_PCA9685_INGEST_SYNC0) return PARSE_BAD;
+    if(len < 2) return PARSE_MORE;
+    if(frame[1] != UDRIVER_PCA9685_INGEST_SYNC1) return PARSE_BAD;
+    if(len < UDRIVER_PCA9685_INGEST_HEADER_BYTES) return PARSE_MORE;
+    
+    int count = frame[4];
+    if(frame[2] >= this->device_count || count < 1 || 
+        frame[3] + count > UDRIVER_PCA9685_PIN_COUNT)
+    {
+        this->stats.invalid ++;
+        return PARSE_BAD;
+    }
+    
+    int frame_len = FRAME_LEN(count);
+    if(len < frame_len) return PARSE_MORE;
+    
+    uint16_t crc = frame[frame_len - 2] | (frame[frame_len - 1] << 8);
+    if(crc16(frame + 2, frame_len - 4) != crc)
+    {
+        this->stats.crc_errors ++;
+        return PARSE_BAD;
+    }
+    
+    for(int i = 0; i < count; i ++)
+    {
+        const uint8_t *value = frame + UDRIVER_PCA9685_INGEST_HEADER_BYTES + i * 2;
+        if((value[0] | (value[1] << 8)) > UDRIVER_PCA9685_PWM_MAX)
+        {
+            this->stats.invalid ++;
+            return PARSE_BAD;
+        }
+    }
+    return PARSE_DONE;
+}
+
+void SerialIngest::enqueue()
+{
+    //Keep the newest frames when the bus is falling behind
+    if((uint8_t)(this->tail - this->head) == UDRIVER_PCA9685_INGEST_QUEUE)
+    {
+        this->head ++;
+        this->stats.dropped ++;
+    }
+    
+    IngestFrame &slot = this->queue[this->tail % UDRIVER_PCA9685_INGEST_QUEUE];
+    slot.device = this->buffer[2];
+    slot.pin = this->buffer[3];
+    slot.count = this->buffer[4];
+    for(int i = 0; i < slot.count; i ++)
+    {
+        const uint8_t *value = this->buffer + UDRIVER_PCA9685_INGEST_HEADER_BYTES + i * 2;
+        slot.values[i] = value[0] | (value[1] << 8);
+    }
+    
+    this->tail ++;
+    this->stats.frames ++;
+}
+
+int SerialIngest::service()
+{
+    int written = 0;
+    while(this->head != this->tail)
+    {
+        IngestFrame &slot = this->queue[this->head % UDRIVER_PCA9685_INGEST_QUEUE];
+        uint64_t start_us = system_timer_current_time_us();
+        int status = this->devices[slot.device]->pwm_write_burst((Pin)slot.pin, 
+            slot.values, slot.count);
+        this->stats.bus_us += system_timer_current_time_us() - start_us;
+        
+        this->head ++;
+        if(status != MICROBIT_OK)
+        {
+            this->stats.dropped ++;
+            return status;
+        }
+        this->stats.written ++;
+        written ++;
+    }
+    return written;
+}
+
+int SerialIngest::pump()
+{
+    //Bytes keep arriving by interrupt while service() holds the bus, so the
+    //RX buffer must hold the frames received meanwhile
+    if(!this->rx_sized)
+    {
+        uBit.serial.setRxBufferSize(UDRIVER_PCA9685_INGEST_RX_BUFFER);
+        this->rx_sized = true;
+    }
+    uint8_t data[UDRIVER_PCA9685_INGEST_FRAME_MAX];
+    int len = uBit.serial.read(data, sizeof(data), ASYNC);
+    if(len > 0) this->feed(data, len);
+    return this->service();
+}
+
+const IngestStats &SerialIngest::get_stats()
+{
+    return this->stats;
+}
+
+void SerialIngest::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(IngestStats));
+}
@@ -0,0 +1,95 @@
+#ifndef UDRIVER_PCA9685_INGEST
+#define UDRIVER_PCA9685_INGEST
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_INGEST_SYNC0 0xA5
+#define UDRIVER_PCA9685_INGEST_SYNC1 0x5A
+#define UDRIVER_PCA9685_INGEST_HEADER_BYTES 5 /* Sync, device, Pin, count */
+#define UDRIVER_PCA9685_INGEST_FRAME_MAX (UDRIVER_PCA9685_INGEST_HEADER_BYTES \
+    + UDRIVER_PCA9685_PIN_COUNT * 2 + 2)
+#define UDRIVER_PCA9685_INGEST_QUEUE 4 /* Frames decoded ahead of the bus */
+#define UDRIVER_PCA9685_INGEST_RX_BUFFER (UDRIVER_PCA9685_INGEST_FRAME_MAX * 4) /* Serial RX bytes */
+namespace UDriver_PCA9685 
+{
+    /* Counters reported by the SerialIngest */
+    typedef struct ingest_stats_t
+    {
+        uint32_t bytes; /* Bytes fed */
+        uint32_t frames; /* Frames decoded */
+        uint32_t written; /* Frames written to their PCA9685 */
+        uint32_t dropped; /* Decoded frames overwritten or failing to write */
+        uint32_t crc_errors; /* Frames failing their CRC */
+        uint32_t invalid; /* Frames with a bad header or value */
+        uint32_t skipped; /* Bytes skipped while resynchronising */
+        uint32_t bus_us; /* Time spent writing frames */
+    }IngestStats;
+
+    /* Streams binary frames, such as from a PC over USB serial, into 
+     * several PCA9685s. Each frame sets consecutive PWM Pins of one device:
+     *     byte 0-1  sync 0xA5 0x5A
+     *     byte 2    index of the device
+     *     byte 3    first PWM Pin
+     *     byte 4    number of PWM Pins, 1-16
+     *     byte 5-   PWM values between 0-4095, 16 bit little endian
+     *     last 2    CRC-16/CCITT-FALSE of bytes 2 onwards, little endian
+     * A corrupt frame is dropped and decoding resumes at the next sync.
+     * Decoding runs ahead of the bus, so frames received while a burst is 
+     * being written are decoded straight after it. When the bus cannot keep
+     * up the oldest decoded frames are dropped.
+    */
+    class SerialIngest
+    {
+    public:
+        /* Ingest frames for the 'count' devices, indexed by their position */
+        SerialIngest(PCA9685 **devices, int count);
+
+        /* Decode 'len' bytes of the stream. Returns the frames completed. */
+        int feed(const uint8_t *data, int len);
+
+        /* Write the decoded frames to their devices, one burst each. A frame
+         * whose burst fails is dropped and the rest are left for the next call.
+         * Returns the number of frames written, or an error status. */
+        int service();
+
+        /* Feed the bytes waiting on the MicroBit's serial port and service.
+         * The first call enlarges the serial RX buffer, which by default is
+         * smaller than a frame, to UDRIVER_PCA9685_INGEST_RX_BUFFER bytes.
+         * Call this in a loop from a fiber. */
+        int pump();
+
+        /* Encode a frame of 'count' values into 'frame', which must hold 
+         * UDRIVER_PCA9685_INGEST_FRAME_MAX bytes. Returns its length. */
+        static int encode(uint8_t device, Pin pin, const uint16_t *values, 
+                int count, uint8_t *frame);
+
+        /* CRC-16/CCITT-FALSE of 'len' bytes, continuing from 'crc' */
+        static uint16_t crc16(const uint8_t *data, int len, uint16_t crc=0xFFFF);
+
+        const IngestStats &get_stats();
+        void reset_stats();
+
+    protected:
+        typedef struct ingest_frame_t
+        {
+            uint8_t device;
+            uint8_t pin;
+            uint8_t count;
+            uint16_t values[UDRIVER_PCA9685_PIN_COUNT];
+        }IngestFrame;
+
+        PCA9685 **devices;
+        uint8_t device_count;
+        uint8_t buffer[UDRIVER_PCA9685_INGEST_FRAME_MAX]; /* Frame being received */
+        uint8_t buffer_len = 0;
+        IngestFrame queue[UDRIVER_PCA9685_INGEST_QUEUE];
+        uint8_t head = 0; /* Next frame to write */
+        uint8_t tail = 0; /* Next free slot */
+        bool rx_sized = false; /* Serial RX buffer enlarged */
+        IngestStats stats;
+
+        int parse();
+        void enqueue();
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_INGEST */
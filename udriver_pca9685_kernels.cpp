@@ -0,0 +1,69 @@
+/*
+ * udriver_pca9685_kernels.cpp
+ * Bulk conversion kernels for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_kernels.h"
+
+#if defined(__GNUC__)
+#define RESTRICT __restrict__
+#else
+#define RESTRICT
+#endif
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+void Kernels::angles_to_pulses(const uint16_t *RESTRICT angles, 
+        const uint16_t *RESTRICT min_us, const uint16_t *RESTRICT max_us, 
+        uint16_t *RESTRICT pulses, int count)
+{
+    for(int i = 0; i < count; i ++)
+    {
+        uint32_t angle = angles[i];
+        angle = (angle > UDRIVER_PCA9685_ANGLE_MAX) ? UDRIVER_PCA9685_ANGLE_MAX : angle;
+        int32_t range = (int32_t)max_us[i] - min_us[i];
+        pulses[i] = min_us[i] + (range * (int32_t)angle + UDRIVER_PCA9685_ANGLE_MAX / 2) 
+            / UDRIVER_PCA9685_ANGLE_MAX;
+    }
+}
+
+void Kernels::pulses_to_values(const uint16_t *RESTRICT pulses, 
+        uint16_t *RESTRICT values, int count, int frequency)
+{
+    if(frequency <= 0) return;
+
+    //pulse * frequency * 4095 / 1000000 rounded exactly, with the fraction
+    //reduced by 5. Clamping to the period keeps pulse * frequency within 
+    //1000000, so this fits in 32 bits
+    uint32_t period_us = 1000000UL / frequency;
+
+    for(int i = 0; i < count; i ++)
+    {
+        uint32_t pulse = pulses[i];
+        pulse = (pulse > period_us) ? period_us : pulse;
+        uint32_t value = (pulse * frequency * 819 + 100000) / 200000;
+        values[i] = (value > UDRIVER_PCA9685_PWM_MAX) ? UDRIVER_PCA9685_PWM_MAX : value;
+    }
+}
+
+void Kernels::levels_to_values(const uint16_t *RESTRICT levels, 
+        uint16_t *RESTRICT values, int count)
+{
+    for(int i = 0; i < count; i ++)
+        values[i] = ((uint32_t)levels[i] * UDRIVER_PCA9685_PWM_MAX + 32767) / 65535;
+}
+
+void Kernels::encode_bursts(const uint16_t *RESTRICT values, uint8_t *RESTRICT regs,
+        int devices)
+{
+    int count = devices * UDRIVER_PCA9685_PIN_COUNT;
+    for(int i = 0; i < count; i ++)
+    {
+        uint16_t value = values[i];
+        regs[i * 4 + 0] = 0x00; //ON least significant 8 bits
+        regs[i * 4 + 1] = 0x00; //ON most significant 4 bits
+        regs[i * 4 + 2] = value & 0xFF;
+        regs[i * 4 + 3] = (value >> 8) & 0x0F;
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef UDRIVER_PCA9685_KERNELS
+#define UDRIVER_PCA9685_KERNELS
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_ANGLE_MAX 1800 /* Angles in tenths of a degree */
+#define UDRIVER_PCA9685_BURST_BYTES \
+    (UDRIVER_PCA9685_PIN_COUNT * UDRIVER_PCA9685_CHANNEL_BYTES)
+namespace UDriver_PCA9685 
+{
+    /* Array conversion kernels for driving many PWM Pins on many PCA9685s.
+     * Each kernel works on contiguous arrays, in integer math with no 
+     * branches in the loop body, so that compilers can vectorize them.
+     * Arrays must not overlap.
+    */
+    namespace Kernels
+    {
+        /* Convert 'count' angles in tenths of a degree between 0-1800 into
+         * pulses in microseconds, scaled between each PWM Pin's pulse range */
+        void angles_to_pulses(const uint16_t *angles, const uint16_t *min_us, 
+                const uint16_t *max_us, uint16_t *pulses, int count);
+        
+        /* Convert 'count' pulses in microseconds into PWM values between
+         * 0-4095 at the given PWM modulation frequency in hertz, rounding to
+         * the nearest. PCA9685::pwm_pulse() converts with this kernel too.
+         * Pulses longer than the period are clamped. */
+        void pulses_to_values(const uint16_t *pulses, uint16_t *values, 
+                int count, int frequency);
+
+        /* Convert 'count' duty cycles between 0-65535 into PWM values */
+        void levels_to_values(const uint16_t *levels, uint16_t *values, int count);
+
+        /* Encode 'devices' x 16 PWM values into 'devices' consecutive burst
+         * buffers of UDRIVER_PCA9685_BURST_BYTES, each ready to send with
+         * PCA9685::channel_write_burst(Pin_P0, ...). */
+        void encode_bursts(const uint16_t *values, uint8_t *regs, int devices);
+    }
+}
+#endif /* ifndef UDRIVER_PCA9685_KERNELS */
@@ -0,0 +1,100 @@
+/*
+ * udriver_pca9685_mailbox.cpp
+ * Lock free PWM value mailbox for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_mailbox.h"
+
+#define MAILBOX_FRESH 0x80 /* Set in middle when it holds an unread frame */
+#define MAILBOX_INDEX 0x03
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+Mailbox::Mailbox(PCA9685 &device) : device(device)
+{
+    memset(this->building, 0, sizeof(this->building));
+    memset(this->written, 0, sizeof(this->written));
+    this->reset_stats();
+}
+
+void Mailbox::set(Pin pin, uint16_t value)
+{
+    if(value > UDRIVER_PCA9685_PWM_MAX) return;
+
+    this->building[pin] = value;
+}
+
+void Mailbox::publish()
+{
+    Frame &frame = this->frames[this->back];
+    memcpy(frame.values, this->building, sizeof(this->building));
+    frame.stamp_us = system_timer_current_time_us();
+    
+    //The consumer runs in a fiber and never interrupts the producer, so this
+    //exchange is already atomic from the producer's side
+    uint8_t previous = this->middle;
+    this->middle = this->back | MAILBOX_FRESH;
+    this->back = previous & MAILBOX_INDEX;
+    this->stats.published ++;
+}
+
+int Mailbox::service()
+{
+    if(!(this->middle & MAILBOX_FRESH)) return 0;
+
+    //The producer may be an interrupt, so exchange with interrupts held off
+    __disable_irq();
+    uint8_t previous = this->middle;
+    this->middle = this->front;
+    __enable_irq();
+    this->front = previous & MAILBOX_INDEX;
+    this->stats.consumed ++;
+
+    //One burst spanning every changed PWM Pin
+    Frame &frame = this->frames[this->front];
+    int first = UDRIVER_PCA9685_PIN_COUNT;
+    int last = -1;
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        if(this->known && frame.values[pin] == this->written[pin]) continue;
+        first = (pin < first) ? pin : first;
+        last = pin;
+    }
+    
+    int count = 0;
+    if(last >= 0)
+    {
+        count = last - first + 1;
+        int status = this->device.pwm_write_burst((Pin)first, frame.values + first, count);
+        if(status != MICROBIT_OK)
+        {
+            //written[] still holds what the device has, so the next frame
+            //resends these PWM Pins
+            this->stats.errors ++;
+            return status;
+        }
+        memcpy(this->written, frame.values, sizeof(this->written));
+        this->known = true;
+        this->stats.bursts ++;
+    }
+
+    uint32_t latency_us = system_timer_current_time_us() - frame.stamp_us;
+    this->stats.latency_total_us += latency_us;
+    this->stats.latency_max_us = (latency_us > this->stats.latency_max_us) 
+        ? latency_us : this->stats.latency_max_us;
+    this->stats.latency_min_us = (latency_us < this->stats.latency_min_us) 
+        ? latency_us : this->stats.latency_min_us;
+    return count;
+}
+
+const MailboxStats &Mailbox::get_stats()
+{
+    return this->stats;
+}
+
+void Mailbox::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(MailboxStats));
+    this->stats.latency_min_us = UINT32_MAX;
+}
@@ -0,0 +1,65 @@
+#ifndef UDRIVER_PCA9685_MAILBOX
+#define UDRIVER_PCA9685_MAILBOX
+
+#include "udriver_pca9685.h"
+
+namespace UDriver_PCA9685 
+{
+    /* Producer write to bus transmission latency reported by the Mailbox */
+    typedef struct mailbox_stats_t
+    {
+        uint32_t published; /* Frames published by the producer */
+        uint32_t consumed; /* Frames taken by the consumer */
+        uint32_t bursts; /* i2c bursts sent */
+        uint32_t errors; /* Failed bursts, resent with the next frame */
+        uint32_t latency_min_us;
+        uint32_t latency_max_us;
+        uint64_t latency_total_us; /* Divide by consumed for the average */
+    }MailboxStats;
+
+    /* Lock free single producer, single consumer mailbox holding the PWM
+     * values of all PWM Pins of a PCA9685. The producer, which may be an
+     * interrupt handler or a fiber, sets values and publishes them without
+     * touching the bus. The fiber owning the bus calls service() to take the
+     * latest published frame and burst write the PWM Pins that changed.
+     * Frames are triple buffered so neither side ever waits for the other;
+     * frames published faster than they are consumed are merged.
+    */
+    class Mailbox
+    {
+    public:
+        Mailbox(PCA9685 &device);
+
+        /* Producer: set the PWM value between 0-4095 of the given PWM Pin in
+         * the frame being built */
+        void set(Pin pin, uint16_t value);
+
+        /* Producer: publish the frame being built to the consumer */
+        void publish();
+
+        /* Consumer: write the latest published frame, if any, to the device.
+         * Returns the number of PWM Pins written, or an error status. */
+        int service();
+
+        const MailboxStats &get_stats();
+        void reset_stats();
+
+    protected:
+        typedef struct frame_t
+        {
+            uint16_t values[UDRIVER_PCA9685_PIN_COUNT];
+            uint32_t stamp_us; /* When the producer published the frame */
+        }Frame;
+
+        PCA9685 &device;
+        Frame frames[3];
+        uint16_t building[UDRIVER_PCA9685_PIN_COUNT]; /* Producer's frame */
+        uint16_t written[UDRIVER_PCA9685_PIN_COUNT]; /* Consumer's last frame */
+        uint8_t back = 0; /* Owned by the producer */
+        uint8_t front = 1; /* Owned by the consumer */
+        volatile uint8_t middle = 2; /* Exchanged by both sides */
+        bool known = false; /* Consumer has written a frame */
+        MailboxStats stats;
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_MAILBOX */
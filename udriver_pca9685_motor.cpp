@@ -0,0 +1,180 @@
+/*
+ * udriver_pca9685_motor.cpp
+ * H-bridge motor pairs for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_motor.h"
+
+#define MOTOR_PERIOD 4096 /* Counter ticks per PWM period */
+#define MOTOR_FULL 0x1000 /* FULL ON/OFF bit in the ON/OFF counter values */
+#define PAIR_BYTES (2 * UDRIVER_PCA9685_CHANNEL_BYTES)
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+MotorPair::MotorPair(PCA9685 &device, Pin pin, MotorDrive drive, int dead_ticks, 
+        int offset) : device(device), pin(pin), drive(drive)
+{
+    this->dead_ticks = (dead_ticks < 0) ? 0 : dead_ticks;
+    this->offset = offset & (MOTOR_PERIOD - 1);
+}
+
+/* Encode an input on from 'on' for 'width' ticks, FULL OFF if there are none */
+static void encode_input(int on, int width, uint8_t *regs)
+{
+    if(width <= 0)
+        PCA9685::encode_channel(0, MOTOR_FULL, regs);
+    else if(width >= MOTOR_PERIOD)
+        PCA9685::encode_channel(MOTOR_FULL, 0, regs);
+    else
+        PCA9685::encode_channel(on & (MOTOR_PERIOD - 1), (on + width) & (MOTOR_PERIOD - 1), regs);
+}
+
+static int clamp_speed(int speed)
+{
+    if(speed > UDRIVER_PCA9685_MOTOR_SPEED_MAX) return UDRIVER_PCA9685_MOTOR_SPEED_MAX;
+    if(speed < -UDRIVER_PCA9685_MOTOR_SPEED_MAX) return -UDRIVER_PCA9685_MOTOR_SPEED_MAX;
+    return speed;
+}
+
+void MotorPair::encode(int speed, uint8_t *regs) const
+{
+    speed = clamp_speed(speed);
+    uint8_t *a = regs, *b = regs + UDRIVER_PCA9685_CHANNEL_BYTES;
+
+    if(this->drive == Drive_SignMagnitude)
+    {
+        encode_input(this->offset, (speed > 0) ? speed : 0, a);
+        encode_input(this->offset, (speed < 0) ? -speed : 0, b);
+        return;
+    }
+
+    //A and B split the period around 50%, each giving up a dead time before
+    //the other switches on so their on times stay symmetric
+    int a_share = MOTOR_PERIOD / 2 + speed / 2;
+    encode_input(this->offset, a_share - this->dead_ticks, a);
+    encode_input(this->offset + a_share, MOTOR_PERIOD - a_share - this->dead_ticks, b);
+}
+
+int MotorPair::write(int speed, bool on)
+{
+    if(this->pin > Pin_P14) return MICROBIT_INVALID_PARAMETER;
+
+    uint8_t regs[PAIR_BYTES];
+    if(on) 
+        this->encode(speed, regs);
+    else
+    {
+        PCA9685::encode_channel(0, MOTOR_FULL, regs);
+        PCA9685::encode_channel(0, MOTOR_FULL, regs + UDRIVER_PCA9685_CHANNEL_BYTES);
+    }
+    int status = this->device.channel_write_burst(this->pin, regs, 2);
+    if(status == MICROBIT_OK) this->speed = speed;
+    return status;
+}
+
+int MotorPair::set_speed(int speed)
+{
+    if(speed < -UDRIVER_PCA9685_MOTOR_SPEED_MAX || speed > UDRIVER_PCA9685_MOTOR_SPEED_MAX)
+        return MICROBIT_INVALID_PARAMETER;
+    return this->write(speed, true);
+}
+
+int MotorPair::coast()
+{
+    return this->write(0, false);
+}
+
+int MotorPair::brake()
+{
+    if(this->drive == Drive_Complementary) return this->write(0, true);
+    if(this->pin > Pin_P14) return MICROBIT_INVALID_PARAMETER;
+
+    uint8_t regs[PAIR_BYTES];
+    PCA9685::encode_channel(MOTOR_FULL, 0, regs);
+    PCA9685::encode_channel(MOTOR_FULL, 0, regs + UDRIVER_PCA9685_CHANNEL_BYTES);
+    int status = this->device.channel_write_burst(this->pin, regs, 2);
+    if(status == MICROBIT_OK) this->speed = 0;
+    return status;
+}
+
+int MotorPair::get_speed()
+{
+    return this->speed;
+}
+
+PCA9685 &MotorPair::get_device()
+{
+    return this->device;
+}
+
+Pin MotorPair::get_pin()
+{
+    return this->pin;
+}
+
+MotorBank::MotorBank()
+{
+    memset(&this->stats, 0, sizeof(MotorStats));
+}
+
+int MotorBank::attach(MotorPair *pair)
+{
+    if(pair->pin > Pin_P14) return MICROBIT_INVALID_PARAMETER;
+    if(this->count == UDRIVER_PCA9685_MOTOR_PAIRS) return MICROBIT_NO_RESOURCES;
+
+    //Insert in order of device and PWM Pin, refusing overlaps
+    int at = this->count;
+    for(int i = 0; i < this->count; i ++)
+    {
+        MotorPair *other = this->pairs[i];
+        if(&other->device != &pair->device) continue;
+        if(other->pin + 1 >= pair->pin && other->pin <= pair->pin + 1)
+            return MICROBIT_INVALID_PARAMETER;
+    }
+    while(at > 0 && (&this->pairs[at - 1]->device > &pair->device 
+        || (&this->pairs[at - 1]->device == &pair->device && this->pairs[at - 1]->pin > pair->pin)))
+    {
+        this->pairs[at] = this->pairs[at - 1];
+        this->index[at] = this->index[at - 1];
+        at --;
+    }
+    this->pairs[at] = pair;
+    this->index[at] = this->count;
+    return this->count ++;
+}
+
+int MotorBank::set_speeds(const int16_t *speeds)
+{
+    uint8_t regs[UDRIVER_PCA9685_PIN_COUNT * UDRIVER_PCA9685_CHANNEL_BYTES];
+    int bursts = 0;
+    for(int i = 0; i < this->count; )
+    {
+        //Extend the run while the next pair follows on the same device
+        int end = i + 1;
+        while(end < this->count && &this->pairs[end]->device == &this->pairs[i]->device
+            && this->pairs[end]->pin == this->pairs[end - 1]->pin + 2) end ++;
+        for(int j = i; j < end; j ++)
+            this->pairs[j]->encode(speeds[this->index[j]], regs + (j - i) * PAIR_BYTES);
+
+        int status = this->pairs[i]->device.channel_write_burst(this->pairs[i]->pin, 
+                regs, 2 * (end - i));
+        if(status != MICROBIT_OK) return status;
+        for(int j = i; j < end; j ++) this->pairs[j]->speed = clamp_speed(speeds[this->index[j]]);
+        this->stats.updates += end - i;
+        this->stats.bursts ++;
+        bursts ++;
+        i = end;
+    }
+    return bursts;
+}
+
+const MotorStats &MotorBank::get_stats()
+{
+    return this->stats;
+}
+
+void MotorBank::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(MotorStats));
+}
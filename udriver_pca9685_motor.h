@@ -0,0 +1,98 @@
+#ifndef UDRIVER_PCA9685_MOTOR
+#define UDRIVER_PCA9685_MOTOR
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_MOTOR_SPEED_MAX UDRIVER_PCA9685_PWM_MAX
+#define UDRIVER_PCA9685_MOTOR_PAIRS 16 /* Motor pairs in a MotorBank */
+namespace UDriver_PCA9685 
+{
+    /* Defines how a motor pair drives the two inputs of its H-bridge */
+    typedef enum motor_drive_t
+    {
+        Drive_SignMagnitude = 0, /* One input PWMs, the other is held off */
+        Drive_Complementary = 1 /* Inputs alternate; 50% duty is stopped */
+    }MotorDrive;
+
+    /* Counters reported by the MotorBank */
+    typedef struct motor_stats_t
+    {
+        uint32_t updates; /* Motor pair speeds written */
+        uint32_t bursts; /* i2c bursts sent */
+    }MotorStats;
+
+    /* DC motor on an H-bridge, driven from two consecutive PWM Pins, 'pin' 
+     * for the A input and 'pin' + 1 for the B input. Both PWM Pins are 
+     * written in one burst, and as the PCA9685 changes its outputs on the i2c
+     * STOP, a change of direction never leaves both inputs driven.
+     * With Drive_Complementary each input switches on 'dead_ticks' counter 
+     * ticks after the other switches off, both giving up the same time so
+     * speed 0 drives neither way. Pairs can be given different 
+     * 'offset's so they do not all switch on the same counter tick.
+    */
+    class MotorPair
+    {
+    public:
+        MotorPair(PCA9685 &device, Pin pin, MotorDrive drive=Drive_SignMagnitude, 
+                int dead_ticks=0, int offset=0);
+
+        /* Set speed between -4095 and 4095, negative being reverse */
+        int set_speed(int speed);
+
+        /* Hold both inputs off, letting the motor spin down */
+        int coast();
+
+        /* Short the motor to stop it: both inputs on with 
+         * Drive_SignMagnitude, speed 0 with Drive_Complementary */
+        int brake();
+
+        /* Encode both PWM Pins for the given speed into 
+         * 2 * UDRIVER_PCA9685_CHANNEL_BYTES registers at 'regs' */
+        void encode(int speed, uint8_t *regs) const;
+
+        int get_speed();
+        PCA9685 &get_device();
+        Pin get_pin();
+
+    protected:
+        PCA9685 &device;
+        Pin pin;
+        MotorDrive drive;
+        uint16_t dead_ticks;
+        uint16_t offset;
+        int16_t speed = 0;
+
+        int write(int speed, bool on);
+        friend class MotorBank;
+    };
+
+    /* Updates many motor pairs together. Pairs are ordered by device and PWM
+     * Pin, and each run of pairs on consecutive PWM Pins of a device is 
+     * written in one burst.
+    */
+    class MotorBank
+    {
+    public:
+        MotorBank();
+
+        /* Add a motor pair, returning its index for set_speeds(), or 
+         * MICROBIT_INVALID_PARAMETER if it shares a PWM Pin with another pair
+         * or MICROBIT_NO_RESOURCES if the bank is full. */
+        int attach(MotorPair *pair);
+
+        /* Set the speeds of all attached pairs, indexed as they were 
+         * attached, clamping out of range speeds. Returns the number of bursts
+         * sent, or an error status. */
+        int set_speeds(const int16_t *speeds);
+
+        const MotorStats &get_stats();
+        void reset_stats();
+
+    protected:
+        MotorPair *pairs[UDRIVER_PCA9685_MOTOR_PAIRS]; /* By device and PWM Pin */
+        uint8_t index[UDRIVER_PCA9685_MOTOR_PAIRS]; /* Attach order of each */
+        int count = 0;
+        MotorStats stats;
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_MOTOR */
@@ -0,0 +1,161 @@
+/*
+ * udriver_pca9685_phase.cpp
+ * Phase staggered ON offsets for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_phase.h"
+
+#define PHASE_SLOTS UDRIVER_PCA9685_PIN_COUNT
+#define PHASE_SLOT_TICKS (UDRIVER_PCA9685_PWM_PERIOD / PHASE_SLOTS)
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+PhaseAllocator::PhaseAllocator(PCA9685 &device, PhaseStrategy strategy) 
+    : device(device), strategy(strategy)
+{
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        this->offset[pin] = pin * PHASE_SLOT_TICKS;
+        this->value[pin] = 0;
+    }
+}
+
+void PhaseAllocator::encode(int pin, uint8_t *regs)
+{
+    int on = this->offset[pin];
+    if(this->value[pin] == 0)
+        PCA9685::encode_channel(0, 0x1000, regs); //FULL OFF
+    else
+        PCA9685::encode_channel(on, (on + this->value[pin]) % UDRIVER_PCA9685_PWM_PERIOD, regs);
+}
+
+int PhaseAllocator::pwm_write(Pin pin, int value)
+{
+    if(value < UDRIVER_PCA9685_PWM_MIN || value > UDRIVER_PCA9685_PWM_MAX)
+        return MICROBIT_INVALID_PARAMETER;
+
+    uint8_t regs[UDRIVER_PCA9685_CHANNEL_BYTES];
+    this->value[pin] = value;
+    this->encode(pin, regs);
+    int status = this->device.channel_write_burst(pin, regs, 1);
+    //No longer a pulse for set_pwm_frequency() to rewrite over the offset
+    if(status == MICROBIT_OK) this->device.clear_pulse_mode(1 << pin);
+    return status;
+}
+
+int PhaseAllocator::pwm_write_frame(const uint16_t *values)
+{
+    uint8_t regs[UDRIVER_PCA9685_PIN_COUNT * UDRIVER_PCA9685_CHANNEL_BYTES];
+
+    if(this->strategy == Phase_LoadBalanced) this->assign(values);
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        this->value[pin] = (values[pin] > UDRIVER_PCA9685_PWM_MAX) ? 0 : values[pin];
+        this->encode(pin, regs + pin * UDRIVER_PCA9685_CHANNEL_BYTES);
+    }
+    int status = this->device.channel_write_burst(Pin_P0, regs, UDRIVER_PCA9685_PIN_COUNT);
+    if(status == MICROBIT_OK) this->device.clear_pulse_mode(0xFFFF);
+    return status;
+}
+
+void PhaseAllocator::assign(const uint16_t *values)
+{
+    if(this->strategy != Phase_LoadBalanced) return;
+
+    //Load in counter ticks carried by each slot of the PWM period
+    uint32_t load[PHASE_SLOTS] = { 0 };
+    uint16_t placed = 0;
+
+    //Out of range values are written as 0, so they carry no load
+    uint16_t widths[UDRIVER_PCA9685_PIN_COUNT];
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+        widths[pin] = (values[pin] > UDRIVER_PCA9685_PWM_MAX) ? 0 : values[pin];
+
+    //Place the widest outputs first, each at the start slot that keeps the
+    //busiest slot it covers as light as possible
+    for(int n = 0; n < UDRIVER_PCA9685_PIN_COUNT; n ++)
+    {
+        int pin = -1;
+        for(int i = 0; i < UDRIVER_PCA9685_PIN_COUNT; i ++)
+        {
+            if(placed & (1 << i)) continue;
+            if(pin < 0 || widths[i] > widths[pin]) pin = i;
+        }
+        placed |= (1 << pin);
+
+        int width = widths[pin];
+        int best_slot = 0;
+        uint32_t best_peak = UINT32_MAX;
+        for(int slot = 0; slot < PHASE_SLOTS; slot ++)
+        {
+            uint32_t peak = 0;
+            for(int covered = 0; covered * PHASE_SLOT_TICKS < width; covered ++)
+            {
+                uint32_t slot_load = load[(slot + covered) % PHASE_SLOTS];
+                peak = (slot_load > peak) ? slot_load : peak;
+            }
+            //Ties go to the emptiest starting slot, spreading rising edges
+            if(peak < best_peak || (peak == best_peak && load[slot] < load[best_slot]))
+            {
+                best_peak = peak;
+                best_slot = slot;
+            }
+        }
+
+        this->offset[pin] = best_slot * PHASE_SLOT_TICKS;
+        for(int remain = width, slot = best_slot; remain > 0; 
+                remain -= PHASE_SLOT_TICKS, slot = (slot + 1) % PHASE_SLOTS)
+        {
+            load[slot] += (remain > PHASE_SLOT_TICKS) ? PHASE_SLOT_TICKS : remain;
+        }
+    }
+}
+
+int PhaseAllocator::get_offset(Pin pin)
+{
+    return this->offset[pin];
+}
+
+int PhaseAllocator::peak_edges(const uint16_t *on, const uint16_t *off, int count)
+{
+    //Only counter ticks with an edge can be a peak, so step through those
+    int peak = 0;
+    for(int i = 0; i < count * 2; i ++)
+    {
+        int output = i / 2;
+        if(on[output] == off[output]) continue;
+        int tick = (i % 2) ? off[output] : on[output];
+
+        int edges = 0;
+        for(int j = 0; j < count; j ++)
+        {
+            if(on[j] == off[j]) continue;
+            if(on[j] == tick) edges ++;
+            if(off[j] == tick) edges ++;
+        }
+        peak = (edges > peak) ? edges : peak;
+    }
+    return peak;
+}
+
+void PhaseAllocator::report(int *peak_before, int *peak_after)
+{
+    uint16_t on[UDRIVER_PCA9685_PIN_COUNT];
+    uint16_t off[UDRIVER_PCA9685_PIN_COUNT];
+
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        on[pin] = 0;
+        off[pin] = this->value[pin];
+    }
+    *peak_before = peak_edges(on, off, UDRIVER_PCA9685_PIN_COUNT);
+
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        on[pin] = this->offset[pin];
+        off[pin] = (this->value[pin] == 0) ? on[pin] 
+            : (on[pin] + this->value[pin]) % UDRIVER_PCA9685_PWM_PERIOD;
+    }
+    *peak_after = peak_edges(on, off, UDRIVER_PCA9685_PIN_COUNT);
+}
@@ -0,0 +1,59 @@
+#ifndef UDRIVER_PCA9685_PHASE
+#define UDRIVER_PCA9685_PHASE
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_PWM_PERIOD 4096 /* Counter ticks per PWM period */
+namespace UDriver_PCA9685 
+{
+    /* Defines how ON offsets are assigned to PWM Pins */
+    typedef enum phase_strategy_t
+    {
+        Phase_RoundRobin = 0, /* Evenly spaced by PWM Pin number */
+        Phase_LoadBalanced = 1 /* Placed by duty to flatten the load */
+    }PhaseStrategy;
+
+    /* Staggers the ON offset of each PWM Pin on a PCA9685 so that outputs
+     * do not all switch on at the same counter tick, spreading the current
+     * spikes on the supply. OFF is computed as (ON + value) % 4096.
+    */
+    class PhaseAllocator
+    {
+    public:
+        PhaseAllocator(PCA9685 &device, PhaseStrategy strategy=Phase_RoundRobin);
+
+        /* PWM write value between 0-4095 to the given PWM Pin, switching on
+         * at the PWM Pin's ON offset */
+        int pwm_write(Pin pin, int value);
+
+        /* PWM write values between 0-4095 to all PWM Pins in a single burst.
+         * With Phase_LoadBalanced the ON offsets are reassigned first. */
+        int pwm_write_frame(const uint16_t *values);
+
+        /* Reassign the ON offsets for the given values of all PWM Pins.
+         * Out of range values count as 0, as they are written. */
+        void assign(const uint16_t *values);
+
+        /* ON offset in counter ticks assigned to the given PWM Pin */
+        int get_offset(Pin pin);
+
+        /* Simulate a PWM period of 'count' outputs with the given ON/OFF
+         * counter values, returning the most outputs switching on the same
+         * counter tick. Outputs with OFF == ON never switch. */
+        static int peak_edges(const uint16_t *on, const uint16_t *off, int count);
+
+        /* Report the peak simultaneous switching edges of the values last
+         * written, with all PWM Pins switching on at 0 ('before') and with
+         * the assigned ON offsets ('after') */
+        void report(int *peak_before, int *peak_after);
+
+    protected:
+        PCA9685 &device;
+        PhaseStrategy strategy;
+        uint16_t offset[UDRIVER_PCA9685_PIN_COUNT];
+        uint16_t value[UDRIVER_PCA9685_PIN_COUNT];
+
+        void encode(int pin, uint8_t *regs);
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_PHASE */
@@ -0,0 +1,174 @@
+/*
+ * udriver_pca9685_planner.cpp
+ * Frequency aware channel placement for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_planner.h"
+
+#undef printf
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+/* Prescale for the frequency, as PCA9685::set_pwm_frequency(). Ref Datasheet */
+#define PLAN_PRESCALE(freq) ((25000000L + 2048L * (freq)) / (4096L * (freq)) - 1)
+#define PLAN_PRESCALE_MIN 0x03
+#define PLAN_PRESCALE_MAX 0xFF
+/* Transactions of set_pwm_frequency(), see README */
+#if UDRIVER_PCA9685_REALTIME
+#define RETUNE_TRANSACTIONS 3
+#define REPULSE_TRANSACTIONS 1 /* Per pulsed PWM Pin */
+#else
+#define RETUNE_TRANSACTIONS 4
+#define REPULSE_TRANSACTIONS 4
+#endif
+
+ChannelPlanner::ChannelPlanner(int chips)
+{
+    this->chip_limit = (chips > UDRIVER_PCA9685_CHANNELMAP_DEVICES) 
+        ? UDRIVER_PCA9685_CHANNELMAP_DEVICES : chips;
+    memset(&this->stats, 0, sizeof(PlanStats));
+}
+
+int ChannelPlanner::plan(const ChannelRequirement *requirements, int count, 
+        ChannelMapping *mappings)
+{
+    this->chip_count = 0;
+    if(count < 0) return MICROBIT_INVALID_PARAMETER;
+    if(count > UDRIVER_PCA9685_CHANNELMAP_MAX) return MICROBIT_NO_RESOURCES;
+    for(int i = 0; i < count; i ++)
+    {
+        if(requirements[i].frequency == 0) return MICROBIT_INVALID_PARAMETER;
+        long prescale = PLAN_PRESCALE(requirements[i].frequency);
+        if(prescale < PLAN_PRESCALE_MIN || prescale > PLAN_PRESCALE_MAX) 
+            return MICROBIT_INVALID_PARAMETER;
+    }
+
+    //Pulse channels first, each on a PCA9685 with exactly their prescale. Then
+    //duty channels, fastest first, so slower ones share the faster PCA9685s
+    bool placed[UDRIVER_PCA9685_CHANNELMAP_MAX];
+    memset(placed, 0, sizeof(placed));
+    for(int pass = 0; pass < 2; pass ++)
+    {
+        ChannelKind kind = (pass == 0) ? Channel_Pulse : Channel_Duty;
+        while(true)
+        {
+            int next = -1;
+            for(int i = 0; i < count; i ++)
+            {
+                if(placed[i] || requirements[i].kind != kind) continue;
+                if(next < 0 || requirements[i].frequency > requirements[next].frequency) 
+                    next = i;
+            }
+            if(next < 0) break;
+            
+            const ChannelRequirement &requirement = requirements[next];
+            int prescale = PLAN_PRESCALE(requirement.frequency);
+            int chip = -1;
+            for(int c = 0; c < this->chip_count && chip < 0; c ++)
+            {
+                if(this->used[c] == UDRIVER_PCA9685_PIN_COUNT) continue;
+                if((kind == Channel_Pulse) ? this->prescale[c] == prescale 
+                        : this->prescale[c] <= prescale) chip = c;
+            }
+            if(chip < 0)
+            {
+                if(this->chip_count == this->chip_limit) 
+                {
+                    this->chip_count = 0;
+                    return MICROBIT_NO_RESOURCES;
+                }
+                chip = this->chip_count ++;
+                this->prescale[chip] = prescale;
+                this->frequency[chip] = requirement.frequency;
+                this->used[chip] = 0;
+            }
+
+            mappings[next].name = requirement.name;
+            mappings[next].device = chip;
+            mappings[next].pin = this->used[chip] ++;
+            placed[next] = true;
+        }
+    }
+
+    this->stats.chips = this->chip_count;
+    this->plan_naive(requirements, count);
+    return this->chip_count;
+}
+
+/* Cost of the same channels taking PWM Pins in the order given */
+void ChannelPlanner::plan_naive(const ChannelRequirement *requirements, int count)
+{
+    this->stats.naive_chips = (count + UDRIVER_PCA9685_PIN_COUNT - 1) / UDRIVER_PCA9685_PIN_COUNT;
+    this->stats.naive_conflicts = 0;
+    this->stats.avoided_transactions = 0;
+    for(int start = 0; start < count; start += UDRIVER_PCA9685_PIN_COUNT)
+    {
+        int end = (start + UDRIVER_PCA9685_PIN_COUNT < count) 
+            ? start + UDRIVER_PCA9685_PIN_COUNT : count;
+        //Distinct prescales the pulse channels need, plus one more if the
+        //fastest of them is too slow for a duty channel
+        uint8_t seen[UDRIVER_PCA9685_PIN_COUNT];
+        int frequencies = 0, pulsed = 0;
+        int fastest_pulse = PLAN_PRESCALE_MAX + 1, fastest_duty = PLAN_PRESCALE_MAX + 1;
+        for(int i = start; i < end; i ++)
+        {
+            int prescale = PLAN_PRESCALE(requirements[i].frequency);
+            if(requirements[i].kind == Channel_Duty)
+            {
+                if(prescale < fastest_duty) fastest_duty = prescale;
+                continue;
+            }
+            pulsed ++;
+            if(prescale < fastest_pulse) fastest_pulse = prescale;
+            bool known = false;
+            for(int j = 0; j < frequencies; j ++) known |= (seen[j] == prescale);
+            if(!known) seen[frequencies ++] = prescale;
+        }
+        if(frequencies > 0 && fastest_duty < fastest_pulse) frequencies ++;
+        if(frequencies < 2) continue;
+
+        this->stats.naive_conflicts ++;
+        this->stats.avoided_transactions += (frequencies - 1) 
+            * (RETUNE_TRANSACTIONS + REPULSE_TRANSACTIONS * pulsed);
+    }
+}
+
+int ChannelPlanner::get_frequency(int chip)
+{
+    if(chip < 0 || chip >= this->chip_count) return 0;
+    return this->frequency[chip];
+}
+
+int ChannelPlanner::apply(PCA9685 **devices)
+{
+    for(int chip = 0; chip < this->chip_count; chip ++)
+    {
+        if(devices[chip]->get_pwm_frequency() == this->frequency[chip]) continue;
+        int status = devices[chip]->set_pwm_frequency(this->frequency[chip]);
+        if(status != MICROBIT_OK) return status;
+    }
+    return MICROBIT_OK;
+}
+
+void ChannelPlanner::report(const ChannelMapping *mappings, int count)
+{
+    for(int chip = 0; chip < this->chip_count; chip ++)
+    {
+        uBit.serial.printf("PCA9685 %d: %d Hz, %d pins\r\n", chip, 
+                this->frequency[chip], this->used[chip]);
+        for(int i = 0; i < count; i ++)
+        {
+            if(mappings[i].device != chip) continue;
+            uBit.serial.printf("  pin %d: %s\r\n", mappings[i].pin, mappings[i].name);
+        }
+    }
+    uBit.serial.printf("In order given: %d PCA9685s, %d retuned, %d transactions "
+            "per retune avoided\r\n", this->stats.naive_chips, 
+            this->stats.naive_conflicts, this->stats.avoided_transactions);
+}
+
+const PlanStats &ChannelPlanner::get_stats()
+{
+    return this->stats;
+}
@@ -0,0 +1,74 @@
+#ifndef UDRIVER_PCA9685_PLANNER
+#define UDRIVER_PCA9685_PLANNER
+
+#include "udriver_pca9685.h"
+#include "udriver_pca9685_channelmap.h"
+
+namespace UDriver_PCA9685 
+{
+    /* How a channel depends on the PWM modulation frequency */
+    typedef enum channel_kind_t
+    {
+        Channel_Pulse = 0, /* Pulse widths, such as servos: needs the frequency */
+        Channel_Duty = 1, /* Duty cycle, such as LEDs: needs at least the frequency */
+    }ChannelKind;
+
+    /* What a logical channel needs from its PCA9685 */
+    typedef struct channel_requirement_t
+    {
+        const char *name; /* Must outlive the plan's mappings */
+        ChannelKind kind;
+        uint16_t frequency; /* In hertz */
+    }ChannelRequirement;
+
+    /* Outcome of a plan, against placing channels in the order given */
+    typedef struct plan_stats_t
+    {
+        uint8_t chips; /* PCA9685s used */
+        uint8_t naive_chips; /* PCA9685s used in the order given */
+        uint8_t naive_conflicts; /* Of those, ones needing several frequencies */
+        uint16_t avoided_transactions; /* Per round of retuning them */
+    }PlanStats;
+
+    /* Places channels onto PCA9685s so that each only ever runs at one PWM
+     * modulation frequency, as the prescaler is shared by all of its PWM
+     * Pins. Pulse channels are grouped by the prescale their frequency needs
+     * and duty channels fill the PCA9685s running at least as fast as they
+     * need, so set_pwm_frequency() is only called once per PCA9685.
+    */
+    class ChannelPlanner
+    {
+    public:
+        /* Plan for up to 'chips' PCA9685s */
+        ChannelPlanner(int chips=UDRIVER_PCA9685_CHANNELMAP_DEVICES);
+
+        /* Place the 'count' channels, writing where each goes into 
+         * 'mappings', ready for ChannelMap::load(). Returns the number of 
+         * PCA9685s used, MICROBIT_INVALID_PARAMETER if a frequency is out of
+         * range, or MICROBIT_NO_RESOURCES if they do not fit. */
+        int plan(const ChannelRequirement *requirements, int count, 
+                ChannelMapping *mappings);
+
+        /* PWM modulation frequency planned for the given PCA9685 */
+        int get_frequency(int chip);
+
+        /* Set each planned PCA9685 to its frequency, once */
+        int apply(PCA9685 **devices);
+
+        /* Print the layout and the retuning avoided to the serial port */
+        void report(const ChannelMapping *mappings, int count);
+
+        const PlanStats &get_stats();
+
+    protected:
+        uint8_t chip_limit;
+        uint8_t chip_count = 0;
+        uint8_t prescale[UDRIVER_PCA9685_CHANNELMAP_DEVICES];
+        uint16_t frequency[UDRIVER_PCA9685_CHANNELMAP_DEVICES];
+        uint8_t used[UDRIVER_PCA9685_CHANNELMAP_DEVICES]; /* PWM Pins taken */
+        PlanStats stats;
+
+        void plan_naive(const ChannelRequirement *requirements, int count);
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_PLANNER */
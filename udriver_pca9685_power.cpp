@@ -0,0 +1,118 @@
+/*
+ * udriver_pca9685_power.cpp
+ * Idle power management for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_power.h"
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+PowerManager::PowerManager(PCA9685 &device, int hold_ms) : device(device)
+{
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        this->last_write_us[pin] = 0;
+        this->set_hold((Pin)pin, hold_ms);
+    }
+    this->reset_stats();
+}
+
+void PowerManager::set_hold(Pin pin, int hold_ms)
+{
+    this->hold_us[pin] = (hold_ms < 0) ? 0 : hold_ms * 1000;
+}
+
+int PowerManager::digital_write(Pin pin, int value)
+{
+    int status = this->wake();
+    if(status != MICROBIT_OK) return status;
+    
+    this->holding &= ~(1 << pin);
+    return this->device.digital_write(pin, value);
+}
+
+int PowerManager::pwm_write(Pin pin, int value)
+{
+    int status = this->wake();
+    if(status != MICROBIT_OK) return status;
+    
+    this->holding &= ~(1 << pin);
+    return this->device.pwm_write(pin, value);
+}
+
+int PowerManager::pwm_pulse(Pin pin, int pulse_us)
+{
+    int status = this->wake();
+    if(status != MICROBIT_OK) return status;
+    
+    //Rewriting the channel also clears a previous full-OFF
+    status = this->device.pwm_pulse(pin, pulse_us);
+    if(status != MICROBIT_OK) return status;
+
+    this->last_write_us[pin] = system_timer_current_time_us();
+    if(this->hold_us[pin] > 0) this->holding |= (1 << pin);
+    return MICROBIT_OK;
+}
+
+int PowerManager::step()
+{
+    if(this->asleep) return MICROBIT_OK;
+
+    uint64_t now_us = system_timer_current_time_us();
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        if(!(this->holding & (1 << pin))) continue;
+        if(now_us - this->last_write_us[pin] < this->hold_us[pin]) continue;
+        
+        int status = this->device.set_full_off((Pin)pin, 1);
+        if(status != MICROBIT_OK) return status;
+        this->holding &= ~(1 << pin);
+        this->stats.releases ++;
+    }
+
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        if(!this->device.is_channel_off((Pin)pin)) return MICROBIT_OK;
+    }
+    
+    int status = this->device.sleep();
+    if(status != MICROBIT_OK) return status;
+    this->asleep = true;
+    this->sleep_start_us = system_timer_current_time_us();
+    this->stats.sleeps ++;
+    return MICROBIT_OK;
+}
+
+int PowerManager::wake()
+{
+    if(!this->asleep) return MICROBIT_OK;
+
+    uint64_t start_us = system_timer_current_time_us();
+    int status = this->device.restart();
+    if(status != MICROBIT_OK) return status;
+    uint64_t now_us = system_timer_current_time_us();
+    
+    uint32_t wake_us = now_us - start_us;
+    this->stats.wake_us += wake_us;
+    this->stats.wake_max_us = (wake_us > this->stats.wake_max_us) 
+        ? wake_us : this->stats.wake_max_us;
+    this->stats.asleep_ms += (start_us - this->sleep_start_us) / 1000;
+    this->asleep = false;
+    return MICROBIT_OK;
+}
+
+bool PowerManager::is_asleep()
+{
+    return this->asleep;
+}
+
+const PowerStats &PowerManager::get_stats()
+{
+    return this->stats;
+}
+
+void PowerManager::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(PowerStats));
+}
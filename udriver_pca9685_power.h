@@ -0,0 +1,60 @@
+#ifndef UDRIVER_PCA9685_POWER
+#define UDRIVER_PCA9685_POWER
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_POWER_HOLD_MS 2000 /* Default servo hold timeout */
+namespace UDriver_PCA9685 
+{
+    /* Counters reported by the PowerManager */
+    typedef struct power_stats_t
+    {
+        uint32_t releases; /* Servo PWM Pins turned full-OFF after their hold */
+        uint32_t sleeps; /* Times the oscillator was put to sleep */
+        uint32_t asleep_ms; /* Time spent asleep, up to the last wake */
+        uint32_t wake_us; /* Extra latency added to commands by waking */
+        uint32_t wake_max_us; /* Longest extra latency of a single wake */
+    }PowerStats;
+
+    /* Turns off what is not needed on a PCA9685 written through it. Servo 
+     * PWM Pins, driven with pwm_pulse(), are turned full-OFF once they have
+     * held their position for the hold timeout, and the PCA9685 is put to
+     * sleep when every PWM Pin is off. The next command turns them back on,
+     * waking the PCA9685 with RESTART.
+    */
+    class PowerManager
+    {
+    public:
+        PowerManager(PCA9685 &device, int hold_ms=UDRIVER_PCA9685_POWER_HOLD_MS);
+
+        /* Change the hold timeout in milliseconds of the given PWM Pin, 
+         * 0 to hold it forever */
+        void set_hold(Pin pin, int hold_ms);
+
+        /* Write through to the PCA9685, waking it if needed */
+        int digital_write(Pin pin, int value);
+        int pwm_write(Pin pin, int value);
+        int pwm_pulse(Pin pin, int pulse_us);
+
+        /* Release servos past their hold and sleep when everything is off.
+         * Call this periodically. Returns an error status on failure. */
+        int step();
+
+        bool is_asleep();
+
+        const PowerStats &get_stats();
+        void reset_stats();
+
+    protected:
+        PCA9685 &device;
+        uint64_t last_write_us[UDRIVER_PCA9685_PIN_COUNT];
+        uint32_t hold_us[UDRIVER_PCA9685_PIN_COUNT];
+        uint64_t sleep_start_us = 0;
+        uint16_t holding = 0; /* Servo PWM Pins waiting out their hold */
+        bool asleep = false;
+        PowerStats stats;
+
+        int wake();
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_POWER */
@@ -0,0 +1,186 @@
+/*
+ * udriver_pca9685_radio.cpp
+ * Radio receiver of packed PWM frames for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_radio.h"
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+MicroBitRadioLink::MicroBitRadioLink(int group)
+{
+    uBit.radio.enable();
+    uBit.radio.setGroup(group);
+}
+
+int MicroBitRadioLink::send(const uint8_t *data, int len)
+{
+    return uBit.radio.datagram.send((uint8_t *)data, len);
+}
+
+int MicroBitRadioLink::receive(uint8_t *data, int len)
+{
+    int received = uBit.radio.datagram.recv(data, len);
+    return (received < 0) ? 0 : received;
+}
+
+int RadioFrame::encode(uint8_t device_id, uint8_t seq, uint16_t mask, 
+        const uint16_t *values, uint8_t *frame)
+{
+    frame[0] = device_id;
+    frame[1] = seq;
+    frame[2] = mask & 0xFF;
+    frame[3] = mask >> 8;
+
+    //Two 12 bit values into every three bytes
+    uint8_t *packed = frame + UDRIVER_PCA9685_RADIO_HEADER_BYTES;
+    int count = 0;
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        if(!(mask & (1 << pin))) continue;
+        
+        uint16_t value = values[pin] & 0xFFF;
+        uint8_t *pair = packed + (count / 2) * 3;
+        if(count % 2 == 0)
+        {
+            pair[0] = value & 0xFF;
+            pair[1] = value >> 8;
+        }
+        else
+        {
+            pair[1] |= (value & 0x0F) << 4;
+            pair[2] = value >> 4;
+        }
+        count ++;
+    }
+
+    return UDRIVER_PCA9685_RADIO_HEADER_BYTES + (count * 3 + 1) / 2;
+}
+
+int RadioFrame::decode(const uint8_t *frame, int len, uint8_t *device_id, 
+        uint8_t *seq, uint16_t *mask, uint16_t *values)
+{
+    if(len < UDRIVER_PCA9685_RADIO_HEADER_BYTES) return MICROBIT_INVALID_PARAMETER;
+
+    *device_id = frame[0];
+    *seq = frame[1];
+    *mask = frame[2] | (frame[3] << 8);
+    
+    int count = 0;
+    for(uint16_t bits = *mask; bits != 0; bits &= bits - 1) count ++;
+    if(len != UDRIVER_PCA9685_RADIO_HEADER_BYTES + (count * 3 + 1) / 2)
+        return MICROBIT_INVALID_PARAMETER;
+
+    const uint8_t *packed = frame + UDRIVER_PCA9685_RADIO_HEADER_BYTES;
+    count = 0;
+    for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+    {
+        if(!(*mask & (1 << pin))) continue;
+
+        const uint8_t *pair = packed + (count / 2) * 3;
+        if(count % 2 == 0) values[pin] = pair[0] | ((pair[1] & 0x0F) << 8);
+        else values[pin] = (pair[1] >> 4) | (pair[2] << 4);
+        count ++;
+    }
+    return MICROBIT_OK;
+}
+
+RadioSender::RadioSender(RadioLink &link, uint8_t device_id) 
+    : link(link), device_id(device_id)
+{
+}
+
+int RadioSender::send(uint16_t mask, const uint16_t *values)
+{
+    uint8_t frame[UDRIVER_PCA9685_RADIO_FRAME_MAX];
+    int len = RadioFrame::encode(this->device_id, this->seq ++, mask, values, frame);
+    return this->link.send(frame, len);
+}
+
+RadioReceiver::RadioReceiver(PCA9685 &device, RadioLink &link, uint8_t device_id)
+    : device(device), link(link), device_id(device_id)
+{
+    this->reset_stats();
+}
+
+int RadioReceiver::poll()
+{
+    uint8_t packet[UDRIVER_PCA9685_RADIO_PACKET_MAX];
+    uint16_t values[UDRIVER_PCA9685_PIN_COUNT];
+    uint16_t pending = 0;
+    int applied = 0;
+    
+    int len;
+    while((len = this->link.receive(packet, sizeof(packet))) > 0)
+    {
+        this->stats.received ++;
+
+        uint8_t device_id, seq;
+        uint16_t mask;
+        uint16_t frame_values[UDRIVER_PCA9685_PIN_COUNT];
+        if(RadioFrame::decode(packet, len, &device_id, &seq, &mask, frame_values) 
+                != MICROBIT_OK || device_id != this->device_id)
+        {
+            this->stats.ignored ++;
+            continue;
+        }
+
+        //Sequence numbers wrap, so newer means ahead by less than half
+        uint64_t now_us = system_timer_current_time_us();
+        if(this->synced && (int8_t)(seq - this->last_seq) <= 0 && 
+            now_us - this->last_applied_us < UDRIVER_PCA9685_RADIO_RESYNC_MS * 1000)
+        {
+            this->stats.stale ++;
+            continue;
+        }
+        this->synced = true;
+        this->last_seq = seq;
+        this->last_applied_us = now_us;
+
+        for(int pin = 0; pin < UDRIVER_PCA9685_PIN_COUNT; pin ++)
+        {
+            if(mask & (1 << pin)) values[pin] = frame_values[pin];
+        }
+        pending |= mask;
+        applied ++;
+    }
+
+    //One burst per run of consecutive PWM Pins, leaving the others alone.
+    //A failed run does not stop the runs after it
+    int result = MICROBIT_OK;
+    int pin = 0;
+    while(pin < UDRIVER_PCA9685_PIN_COUNT)
+    {
+        if(!(pending & (1 << pin)))
+        {
+            pin ++;
+            continue;
+        }
+
+        int start = pin;
+        while(pin < UDRIVER_PCA9685_PIN_COUNT && (pending & (1 << pin))) pin ++;
+        int status = this->device.pwm_write_burst((Pin)start, values + start, pin - start);
+        if(status != MICROBIT_OK)
+        {
+            this->stats.errors ++;
+            result = status;
+            continue;
+        }
+        this->stats.bursts ++;
+    }
+    if(result != MICROBIT_OK) return result;
+    
+    this->stats.applied += applied;
+    return applied;
+}
+
+const RadioStats &RadioReceiver::get_stats()
+{
+    return this->stats;
+}
+
+void RadioReceiver::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(RadioStats));
+}
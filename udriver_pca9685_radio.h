@@ -0,0 +1,119 @@
+#ifndef UDRIVER_PCA9685_RADIO
+#define UDRIVER_PCA9685_RADIO
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_RADIO_HEADER_BYTES 4 /* Device id, sequence, bitmap */
+#define UDRIVER_PCA9685_RADIO_FRAME_MAX (UDRIVER_PCA9685_RADIO_HEADER_BYTES \
+    + UDRIVER_PCA9685_PIN_COUNT * 3 / 2)
+#define UDRIVER_PCA9685_RADIO_PACKET_MAX 32 /* Largest radio packet */
+#define UDRIVER_PCA9685_RADIO_RESYNC_MS 1000 /* Accept any sequence after */
+namespace UDriver_PCA9685 
+{
+    /* Abstracts the radio frames are received from, so that the receiver
+     * can run against a stand-in off target.
+    */
+    class RadioLink
+    {
+    public:
+        /* Send a packet of 'len' bytes */
+        virtual int send(const uint8_t *data, int len) = 0;
+
+        /* Copy the next packet received into 'data', up to 'len' bytes.
+         * Returns the length of the packet, or 0 when there is none. */
+        virtual int receive(uint8_t *data, int len) = 0;
+    };
+
+    /* RadioLink backed by the MicroBit's radio datagrams.
+     * NOTE: Packets are taken from the same queue as the radio package, so
+     * do not receive with both.
+    */
+    class MicroBitRadioLink : public RadioLink
+    {
+    public:
+        /* Enable the radio and join the given radio group */
+        MicroBitRadioLink(int group);
+
+        virtual int send(const uint8_t *data, int len);
+        virtual int receive(uint8_t *data, int len);
+    };
+
+    /* Packed frames setting PWM values on one PCA9685:
+     *     byte 0    device id
+     *     byte 1    sequence number, incremented for every frame
+     *     byte 2-3  bitmap of the PWM Pins set, little endian
+     *     byte 4-   12 bit PWM values of the PWM Pins set in Pin order,
+     *               two values packed into every three bytes
+     * Setting all 16 PWM Pins takes 28 bytes, within a single radio packet.
+    */
+    namespace RadioFrame
+    {
+        /* Encode a frame into 'frame', with a value between 0-4095 for every 
+         * PWM Pin set in 'mask'. Returns the length of the frame. */
+        int encode(uint8_t device_id, uint8_t seq, uint16_t mask, 
+                const uint16_t *values, uint8_t *frame);
+
+        /* Decode 'len' bytes of a frame, unpacking a value for every PWM Pin 
+         * set in the returned '*mask' into 'values', indexed by Pin.
+         * Returns MICROBIT_INVALID_PARAMETER if the frame is malformed. */
+        int decode(const uint8_t *frame, int len, uint8_t *device_id, 
+                uint8_t *seq, uint16_t *mask, uint16_t *values);
+    }
+
+    /* Counters reported by the RadioReceiver */
+    typedef struct radio_stats_t
+    {
+        uint32_t received; /* Packets received */
+        uint32_t applied; /* Frames written to the PCA9685 */
+        uint32_t stale; /* Frames dropped as older than one already applied */
+        uint32_t ignored; /* Frames for other devices or malformed */
+        uint32_t bursts; /* Burst writes made */
+        uint32_t errors; /* Burst writes failed, their frames not applied */
+    }RadioStats;
+
+    /* Sends frames to a RadioReceiver */
+    class RadioSender
+    {
+    public:
+        RadioSender(RadioLink &link, uint8_t device_id);
+
+        /* Send a value between 0-4095 for every PWM Pin set in 'mask' */
+        int send(uint16_t mask, const uint16_t *values);
+
+    protected:
+        RadioLink &link;
+        uint8_t device_id;
+        uint8_t seq = 0;
+    };
+
+    /* Applies frames addressed to its device id to a PCA9685. Frames waiting
+     * are drained together and merged, the newest value of each PWM Pin 
+     * winning, and written with one burst per contiguous run of PWM Pins.
+     * Frames with a sequence number older than one already applied are
+     * dropped, unless none has been applied for UDRIVER_PCA9685_RADIO_RESYNC_MS
+     * so that a restarted sender is picked up again.
+    */
+    class RadioReceiver
+    {
+    public:
+        RadioReceiver(PCA9685 &device, RadioLink &link, uint8_t device_id);
+
+        /* Apply the frames received since the last call. Call this 
+         * periodically or on every radio datagram event. 
+         * Returns the number of frames applied, or an error status. */
+        int poll();
+
+        const RadioStats &get_stats();
+        void reset_stats();
+
+    protected:
+        PCA9685 &device;
+        RadioLink &link;
+        uint8_t device_id;
+        uint8_t last_seq = 0;
+        bool synced = false;
+        uint64_t last_applied_us = 0;
+        RadioStats stats;
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_RADIO */
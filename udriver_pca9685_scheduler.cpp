@@ -0,0 +1,145 @@
+/*
+ * udriver_pca9685_scheduler.cpp
+ * Deadline aware bus scheduler for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_scheduler.h"
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+BusScheduler::BusScheduler(int chunk)
+{
+    this->chunk = (chunk < 1) ? 1 : chunk;
+    for(int i = 0; i < UDRIVER_PCA9685_SCHEDULER_QUEUE; i ++)
+        this->queue[i].used = false;
+    this->reset_stats();
+}
+
+int BusScheduler::submit(PCA9685 &device, Pin pin, const uint16_t *values, 
+        int count, Priority priority, uint64_t deadline_us)
+{
+    if(count <= 0 || pin + count > UDRIVER_PCA9685_PIN_COUNT) 
+        return MICROBIT_INVALID_PARAMETER;
+    
+    for(int i = 0; i < UDRIVER_PCA9685_SCHEDULER_QUEUE; i ++)
+    {
+        Request &request = this->queue[i];
+        if(request.used) continue;
+
+        request.device = &device;
+        request.pin = pin;
+        request.count = count;
+        request.sent = 0;
+        request.priority = priority;
+        request.deadline_us = deadline_us;
+        request.order = this->order ++;
+        memcpy(request.values, values, count * sizeof(uint16_t));
+        request.used = true;
+
+        this->stats.submitted ++;
+        return MICROBIT_OK;
+    }
+    
+    this->stats.rejected ++;
+    return MICROBIT_NO_RESOURCES;
+}
+
+/* Pick the most urgent request: lowest priority class, then earliest 
+ * deadline (requests without a deadline last), then first submitted */
+BusScheduler::Request *BusScheduler::select()
+{
+    Request *best = NULL;
+    for(int i = 0; i < UDRIVER_PCA9685_SCHEDULER_QUEUE; i ++)
+    {
+        Request *request = &this->queue[i];
+        if(!request->used) continue;
+        if(best == NULL) { best = request; continue; }
+
+        if(request->priority != best->priority)
+        {
+            if(request->priority < best->priority) best = request;
+            continue;
+        }
+
+        uint64_t deadline = request->deadline_us ? request->deadline_us : UINT64_MAX;
+        uint64_t best_deadline = best->deadline_us ? best->deadline_us : UINT64_MAX;
+        if(deadline < best_deadline || 
+                (deadline == best_deadline && request->order < best->order))
+            best = request;
+    }
+    return best;
+}
+
+bool BusScheduler::run_once()
+{
+    Request *request = this->select();
+    if(request == NULL) return false;
+    
+    if(this->current != NULL && this->current != request) 
+    {
+        this->stats.preemptions ++;
+        this->current = request;
+    }
+
+    int count = request->count - request->sent;
+    count = (count > this->chunk) ? this->chunk : count;
+    int status = request->device->pwm_write_burst((Pin)(request->pin + request->sent), 
+        request->values + request->sent, count);
+    if(status != MICROBIT_OK)
+    {
+        //Left queued to be retried
+        this->stats.errors ++;
+        return true;
+    }
+    request->sent += count;
+    this->stats.transactions ++;
+
+    if(request->sent < request->count) 
+    {
+        this->current = request;
+        return true;
+    }
+
+    if(request->deadline_us && system_timer_current_time_us() > request->deadline_us)
+        this->stats.deadline_misses ++;
+    this->stats.completed ++;
+    request->used = false;
+    if(this->current == request) this->current = NULL;
+    return true;
+}
+
+int BusScheduler::run(uint32_t budget_us)
+{
+    uint64_t start_us = system_timer_current_time_us();
+    uint32_t errors = this->stats.errors;
+    int transactions = 0;
+    
+    while(this->run_once())
+    {
+        if(this->stats.errors != errors) break;
+        transactions ++;
+        if(budget_us && system_timer_current_time_us() - start_us >= budget_us) 
+            break;
+    }
+    return transactions;
+}
+
+uint64_t BusScheduler::period_deadline(int frequency)
+{
+    if(frequency <= 0) return 0;
+
+    uint64_t period_us = 1000000 / frequency;
+    uint64_t now_us = system_timer_current_time_us();
+    return now_us - (now_us % period_us) + period_us;
+}
+
+const SchedulerStats &BusScheduler::get_stats()
+{
+    return this->stats;
+}
+
+void BusScheduler::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(SchedulerStats));
+}
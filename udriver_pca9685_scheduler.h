@@ -0,0 +1,94 @@
+#ifndef UDRIVER_PCA9685_SCHEDULER
+#define UDRIVER_PCA9685_SCHEDULER
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_SCHEDULER_QUEUE 8
+#define UDRIVER_PCA9685_SCHEDULER_CHUNK 4 /* Default PWM Pins per transaction */
+namespace UDriver_PCA9685 
+{
+    /* Defines the priority classes of bus requests, most urgent first */
+    typedef enum priority_t
+    {
+        Priority_Servo = 0,
+        Priority_Normal = 1,
+        Priority_Bulk = 2
+    }Priority;
+
+    /* Counters reported by the BusScheduler */
+    typedef struct scheduler_stats_t
+    {
+        uint32_t submitted;
+        uint32_t rejected; /* Queue was full */
+        uint32_t completed;
+        uint32_t transactions;
+        uint32_t preemptions; /* Chunked requests interrupted by another */
+        uint32_t deadline_misses; /* Requests completed after their deadline */
+        uint32_t errors; /* Failed transactions, left queued to be retried */
+    }SchedulerStats;
+
+    /* Sits between the API and the PCA9685s sharing a bus, ordering PWM 
+     * writes by priority class and then earliest deadline. Requests larger
+     * than a chunk are split into several transactions so that more urgent
+     * requests may preempt them in between.
+    */
+    class BusScheduler
+    {
+    public:
+        /* Construct a scheduler that sends at most 'chunk' PWM Pins per
+         * transaction */
+        BusScheduler(int chunk=UDRIVER_PCA9685_SCHEDULER_CHUNK);
+
+        /* Queue PWM write of 'count' values between 0-4095 to consecutive 
+         * PWM Pins on the given device, starting at the given PWM Pin.
+         * The values should reach the bus before the 'deadline_us' in system
+         * time microseconds, or 0 for no deadline.
+         * Returns MICROBIT_OK or MICROBIT_NO_RESOURCES if the queue is full.
+        */
+        int submit(PCA9685 &device, Pin pin, const uint16_t *values, int count,
+                Priority priority, uint64_t deadline_us=0);
+
+        /* Perform the single most urgent transaction. If it fails the request
+         * stays queued and the error is counted.
+         * Returns false if there was nothing to do. */
+        bool run_once();
+
+        /* Perform transactions until the queue is empty, a transaction fails,
+         * or until 'budget_us' microseconds have elapsed, if given. 
+         * Returns the number of transactions performed. */
+        int run(uint32_t budget_us=0);
+
+        /* Number of requests in the queue */
+        int pending();
+
+        /* Deadline at the end of the current PWM period at the given PWM
+         * modulation frequency in hertz, i.e "before the next servo period" */
+        static uint64_t period_deadline(int frequency);
+
+        const SchedulerStats &get_stats();
+        void reset_stats();
+
+    protected:
+        typedef struct request_t
+        {
+            PCA9685 *device;
+            uint64_t deadline_us;
+            uint32_t order; /* Submission order, for FIFO within a class */
+            uint16_t values[UDRIVER_PCA9685_PIN_COUNT];
+            uint8_t pin;
+            uint8_t count;
+            uint8_t sent; /* PWM Pins already sent */
+            uint8_t priority;
+            bool used;
+        }Request;
+
+        Request queue[UDRIVER_PCA9685_SCHEDULER_QUEUE];
+        Request *current = NULL; /* Chunked request in progress */
+        SchedulerStats stats;
+        uint32_t order = 0;
+        int chunk;
+
+        Request *select();
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_SCHEDULER */
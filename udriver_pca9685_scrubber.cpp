@@ -0,0 +1,81 @@
+/*
+ * udriver_pca9685_scrubber.cpp
+ * Background register integrity scrubber for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_scrubber.h"
+
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+Scrubber::Scrubber(PCA9685 &device, int budget_percent) : device(device)
+{
+    this->set_budget(budget_percent);
+    this->reset_stats();
+}
+
+void Scrubber::set_budget(int percent)
+{
+    percent = (percent < 1) ? 1 : percent;
+    this->budget_percent = (percent > 100) ? 100 : percent;
+}
+
+int Scrubber::step()
+{
+    uint64_t now_us = system_timer_current_time_us();
+    if(now_us - this->window_start_us >= UDRIVER_PCA9685_SCRUBBER_WINDOW_US)
+    {
+        this->window_start_us = now_us;
+        this->window_bus_us = 0;
+    }
+    
+    //Stay under budget over the window so far
+    uint64_t elapsed_us = now_us - this->window_start_us;
+    if((uint64_t)this->window_bus_us * 100 > elapsed_us * this->budget_percent)
+    {
+        this->stats.skipped ++;
+        return 0;
+    }
+
+    int repaired = 0;
+    int status = this->device.verify_mode();
+    if(status > 0)
+    {
+        //The reset happened at some point since MODE1 was last seen intact
+        uint32_t detect_us = now_us - this->last_check_us;
+        this->stats.detect_us = (detect_us > this->stats.detect_us) 
+            ? detect_us : this->stats.detect_us;
+        this->stats.resets ++;
+    }
+    else if(status == 0)
+    {
+        status = this->device.verify_channel((Pin)this->next_pin);
+        this->next_pin = (this->next_pin + 1) % UDRIVER_PCA9685_PIN_COUNT;
+        if(status > 0) repaired = status;
+    }
+
+    uint64_t done_us = system_timer_current_time_us();
+    this->window_bus_us += done_us - now_us;
+    this->stats.bus_us += done_us - now_us;
+    this->stats.steps ++;
+    if(status < 0)
+    {
+        this->stats.errors ++;
+        return status;
+    }
+
+    this->last_check_us = done_us;
+    this->stats.repaired += repaired;
+    return repaired;
+}
+
+const ScrubberStats &Scrubber::get_stats()
+{
+    return this->stats;
+}
+
+void Scrubber::reset_stats()
+{
+    memset(&this->stats, 0, sizeof(ScrubberStats));
+    this->last_check_us = system_timer_current_time_us();
+}
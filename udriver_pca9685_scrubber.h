@@ -0,0 +1,53 @@
+#ifndef UDRIVER_PCA9685_SCRUBBER
+#define UDRIVER_PCA9685_SCRUBBER
+
+#include "udriver_pca9685.h"
+
+#define UDRIVER_PCA9685_SCRUBBER_BUDGET 5 /* Default percent of bus time */
+#define UDRIVER_PCA9685_SCRUBBER_WINDOW_US 1000000 /* Budget accounting window */
+namespace UDriver_PCA9685 
+{
+    /* Counters reported by the Scrubber */
+    typedef struct scrubber_stats_t
+    {
+        uint32_t steps; /* Slices checked */
+        uint32_t skipped; /* Idle slots skipped to stay within the budget */
+        uint32_t repaired; /* Registers rewritten */
+        uint32_t resets; /* Resets of the PCA9685 detected and restored */
+        uint32_t errors; /* Slices that failed on the bus */
+        uint32_t bus_us; /* Time spent checking */
+        uint32_t detect_us; /* Longest time a reset could have gone unseen */
+    }ScrubberStats;
+
+    /* Checks a PCA9685 against its expected state in the background, one
+     * small slice per idle slot: MODE1 and one PWM Pin, rotating through the
+     * PWM Pins. MODE1 is checked every slice as it reveals a reset. Only
+     * registers that differ are rewritten, and slots are skipped to keep the
+     * time spent under a percentage of the time elapsed.
+    */
+    class Scrubber
+    {
+    public:
+        Scrubber(PCA9685 &device, int budget_percent=UDRIVER_PCA9685_SCRUBBER_BUDGET);
+
+        /* Change the percentage of time between 1-100 that may be spent */
+        void set_budget(int percent);
+
+        /* Check the next slice, if within the budget. Call this when the bus
+         * is idle. Returns the number of registers repaired, or an error. */
+        int step();
+
+        const ScrubberStats &get_stats();
+        void reset_stats();
+
+    protected:
+        PCA9685 &device;
+        uint64_t window_start_us = 0;
+        uint64_t last_check_us = 0; /* Last time MODE1 was seen intact */
+        uint32_t window_bus_us = 0;
+        uint8_t budget_percent;
+        uint8_t next_pin = 0;
+        ScrubberStats stats;
+    };
+}
+#endif /* ifndef UDRIVER_PCA9685_SCRUBBER */
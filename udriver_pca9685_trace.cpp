@@ -0,0 +1,93 @@
+/*
+ * udriver_pca9685_trace.cpp
+ * Tracepoint ring buffer and Chrome trace export for the PCA9685 Driver
+*/
+
+#include "udriver_pca9685_trace.h"
+
+#undef printf
+
+#if UDRIVER_PCA9685_TRACING
+using namespace pxt;
+using namespace UDriver_PCA9685;
+
+static Trace::TraceEvent trace_events[UDRIVER_PCA9685_TRACE_EVENTS];
+static uint32_t trace_head = 0; /* Oldest event */
+static uint32_t trace_tail = 0; /* Next event */
+static uint32_t trace_lost = 0;
+
+/* Small stable number for the current fiber, to lay out its spans on a row */
+static uint16_t trace_thread()
+{
+    static void *fibers[8];
+    for(int i = 0; i < 8; i ++)
+    {
+        if(fibers[i] == currentFiber) return i + 1;
+        if(fibers[i] == NULL)
+        {
+            fibers[i] = currentFiber;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+Trace::Scope::Scope(const char *name) : name(name)
+{
+    this->start_us = system_timer_current_time_us();
+}
+
+Trace::Scope::~Scope()
+{
+    uint32_t now_us = system_timer_current_time_us();
+    record(this->name, this->start_us, now_us - this->start_us);
+}
+
+void Trace::record(const char *name, uint32_t start_us, uint32_t duration_us)
+{
+    if(trace_tail - trace_head == UDRIVER_PCA9685_TRACE_EVENTS)
+    {
+        trace_head ++;
+        trace_lost ++;
+    }
+
+    TraceEvent &event = trace_events[trace_tail % UDRIVER_PCA9685_TRACE_EVENTS];
+    event.name = name;
+    event.start_us = start_us;
+    event.duration_us = duration_us;
+    event.thread = trace_thread();
+    trace_tail ++;
+}
+
+int Trace::read(TraceEvent *events, int max)
+{
+    int count = 0;
+    for(uint32_t i = trace_head; i != trace_tail && count < max; i ++)
+        events[count ++] = trace_events[i % UDRIVER_PCA9685_TRACE_EVENTS];
+    return count;
+}
+
+uint32_t Trace::lost()
+{
+    return trace_lost;
+}
+
+void Trace::clear()
+{
+    trace_head = trace_tail;
+    trace_lost = 0;
+}
+
+void Trace::dump()
+{
+    uBit.serial.printf("{\"traceEvents\":[");
+    for(uint32_t i = trace_head; i != trace_tail; i ++)
+    {
+        const TraceEvent &event = trace_events[i % UDRIVER_PCA9685_TRACE_EVENTS];
+        uBit.serial.printf("%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%u,\"dur\":%u,"
+            "\"pid\":1,\"tid\":%u}", (i == trace_head) ? "" : ",\r\n", event.name, 
+            (unsigned)event.start_us, (unsigned)event.duration_us, (unsigned)event.thread);
+    }
+    uBit.serial.printf("]}\r\n");
+}
+#endif
@@ -0,0 +1,65 @@
+#ifndef UDRIVER_PCA9685_TRACE
+#define UDRIVER_PCA9685_TRACE
+
+#include "pxt.h"
+
+/* Set to 1 to record tracepoints in the driver, dumpable as a Chrome trace.
+ * When 0 the tracepoints compile to nothing. */
+#ifndef UDRIVER_PCA9685_TRACING
+#define UDRIVER_PCA9685_TRACING 0
+#endif
+#define UDRIVER_PCA9685_TRACE_EVENTS 64 /* Events kept, oldest overwritten */
+
+#if UDRIVER_PCA9685_TRACING
+/* Trace the rest of the enclosing scope under the given name */
+#define UDRIVER_PCA9685_TRACE_SCOPE(name) \
+    UDriver_PCA9685::Trace::Scope trace_scope(name)
+#else
+#define UDRIVER_PCA9685_TRACE_SCOPE(name)
+#endif
+
+#if UDRIVER_PCA9685_TRACING
+namespace UDriver_PCA9685 
+{
+    namespace Trace
+    {
+        /* One traced span */
+        typedef struct trace_event_t
+        {
+            const char *name; /* Must be a string literal */
+            uint32_t start_us;
+            uint32_t duration_us;
+            uint16_t thread; /* Fiber the span ran on */
+        }TraceEvent;
+
+        /* Records a span from construction to destruction */
+        class Scope
+        {
+        public:
+            Scope(const char *name);
+            ~Scope();
+
+        protected:
+            const char *name;
+            uint32_t start_us;
+        };
+
+        /* Record a span that has already finished */
+        void record(const char *name, uint32_t start_us, uint32_t duration_us);
+
+        /* Copy up to 'max' events, oldest first. Returns the number copied. */
+        int read(TraceEvent *events, int max);
+
+        /* Events overwritten before being read */
+        uint32_t lost();
+
+        /* Forget all events */
+        void clear();
+
+        /* Write the events as Chrome trace JSON, for chrome://tracing or 
+         * Perfetto, to the MicroBit's serial port */
+        void dump();
+    }
+}
+#endif
+#endif /* ifndef UDRIVER_PCA9685_TRACE */